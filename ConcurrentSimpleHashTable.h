@@ -0,0 +1,380 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace smpl
+{
+    /**
+     * @brief A hash map for keys that rarely change whose values are updated from many threads at once
+     *      (like a registry of reference counts).
+     *      Inserting, erasing and rehashing take a mutex. find() never locks. It reads the currently published bucket layout which a
+     *      writer only changes by filling empty buckets, marking erased ones, or publishing a whole new layout.
+     *
+     *      Every key and value lives in its own slot that is padded to a cache line and never moves, not even when the buckets are
+     *      rehashed. Pointers from find() stay valid until the key is erased and threads updating different keys never share
+     *      a cache line. Value is meant to hold atomics (like std::atomic<int> or a struct of them) so updating it needs no lock at all.
+     *
+     *      Erased slots and old layouts are freed once no reader can still be using them. Readers announce themselves by incrementing
+     *      one of READER_SLOTS padded counters (read-copy-update with counters). A writer that retires something flips the epoch and
+     *      waits for the counters of the old epoch to drain. Only writers ever wait.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     */
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    class ConcurrentSimpleHashMap
+    {
+    private:
+        struct alignas(64) Slot
+        {
+            template<typename... Args>
+            Slot(const Key& key, Args&&... args) : key(key), value(std::forward<Args>(args)...) {}
+
+            const Key key;
+            Value value;
+        };
+
+    public:
+        /**
+         * @brief Keeps everything a thread can reach through the map from being freed while it exists.
+         *      find() and visit() take one internally. Hold one while using a pointer from find() if another thread may erase its key.
+         *      A thread holding one must not erase() from the same map or insert enough to make it rehash. Both wait for every
+         *      reader to finish (including this one) so they throw std::runtime_error instead of deadlocking.
+         *
+         */
+        class ReadGuard
+        {
+        public:
+            ReadGuard(const ConcurrentSimpleHashMap& map) : map(map)
+            {
+                readerSlot = getReaderSlot();
+                while(true)
+                {
+                    uint64_t epoch = map.epoch.load();
+                    parity = epoch & 1;
+                    //Both must stay seq_cst along with the writer's epoch flip and count loads in waitForReaders(). If the writer
+                    //  misses this count, the epoch load below sees the flip (and what was unpublished before it) and the reader retries.
+                    //  With acquire and release alone the count store and the epoch load could be reordered (only x86 prevents it).
+                    map.readers[readerSlot].counts[parity].fetch_add(1, std::memory_order_seq_cst);
+                    if(map.epoch.load(std::memory_order_seq_cst) == epoch)
+                        break;
+                    map.readers[readerSlot].counts[parity].fetch_sub(1); //a writer flipped the epoch in between. Count toward the new one
+                }
+                previous = innermostGuard;
+                innermostGuard = this;
+            }
+
+            ~ReadGuard()
+            {
+                innermostGuard = previous;
+                map.readers[readerSlot].counts[parity].fetch_sub(1, std::memory_order_release);
+            }
+
+            ReadGuard(const ReadGuard& other) = delete;
+            ReadGuard& operator=(const ReadGuard& other) = delete;
+
+        private:
+            friend class ConcurrentSimpleHashMap;
+
+            const ConcurrentSimpleHashMap& map;
+            size_t readerSlot = 0;
+            size_t parity = 0;
+            const ReadGuard* previous = nullptr; //guards are scoped so each thread's guards form a stack
+        };
+
+        /**
+         * @brief Construct a new Concurrent Simple Hash Map.
+         *
+         * @param initSize
+         *      Number of keys to make room for before the first rehash.
+         */
+        ConcurrentSimpleHashMap(size_t initSize = 0)
+        {
+            size_t bucketCount = 1024;
+            while(initSize >= bucketCount*MAX_LOAD)
+                bucketCount *= 2;
+            layout.store(new Layout(bucketCount));
+        }
+
+        ConcurrentSimpleHashMap(const ConcurrentSimpleHashMap& other) = delete;
+        ConcurrentSimpleHashMap& operator=(const ConcurrentSimpleHashMap& other) = delete;
+
+        /**
+         * @brief Destroy the map. No other thread may be using it.
+         *
+         */
+        ~ConcurrentSimpleHashMap()
+        {
+            Layout* current = layout.load();
+            for(size_t i=0; i<current->bucketCount; i++)
+            {
+                Slot* slot = current->buckets[i].slot.load(std::memory_order_relaxed);
+                if(slot != nullptr && slot != TOMBSTONE)
+                    delete slot;
+            }
+            delete current;
+        }
+
+        /**
+         * @brief Inserts the key with a value constructed from args if it does not exist. Takes the writer lock.
+         *      Returns a pointer to the value of the key and whether it was inserted.
+         *
+         * @tparam Args
+         * @param key
+         * @param args
+         * @return std::pair<Value*, bool>
+         */
+        template<typename... Args>
+        std::pair<Value*, bool> try_emplace(const Key& key, Args&&... args)
+        {
+            uint64_t hash = hasher(key);
+            std::lock_guard<std::mutex> lock(writerMutex);
+            Layout* current = layout.load(std::memory_order_relaxed);
+            Slot* existing = search(current, hash, key);
+            if(existing != nullptr)
+                return {&existing->value, false};
+
+            if((double)(elementCount + current->tombstoneCount + 1) > current->bucketCount*MAX_LOAD)
+            {
+                throwIfReading();
+                current = rehash(elementCount + 1);
+            }
+
+            Slot* slot = new Slot(key, std::forward<Args>(args)...);
+            size_t location = hash & (current->bucketCount-1);
+            while(current->buckets[location].slot.load(std::memory_order_relaxed) != nullptr)
+                location = (location+1) & (current->bucketCount-1);
+
+            //readers only look at the hash after they see the slot so it is written first
+            current->buckets[location].hash = hash;
+            current->buckets[location].slot.store(slot, std::memory_order_release);
+            elementCount++;
+            return {&slot->value, true};
+        }
+
+        /**
+         * @brief Removes the key if it exists. Takes the writer lock and waits until no reader can still be using the value before destroying it.
+         *      Returns if anything was removed.
+         *      Throws std::runtime_error if the calling thread holds a ReadGuard on this map since it would wait for itself forever.
+         *
+         * @param key
+         * @return bool
+         */
+        bool erase(const Key& key)
+        {
+            uint64_t hash = hasher(key);
+            std::lock_guard<std::mutex> lock(writerMutex);
+            Layout* current = layout.load(std::memory_order_relaxed);
+            size_t location = hash & (current->bucketCount-1);
+            while(true)
+            {
+                Slot* slot = current->buckets[location].slot.load(std::memory_order_relaxed);
+                if(slot == nullptr)
+                    return false;
+                if(slot != TOMBSTONE && current->buckets[location].hash == hash && keyEqualFunc(slot->key, key))
+                {
+                    throwIfReading();
+                    //the bucket stays taken so searches for keys after it in the run keep going
+                    current->buckets[location].slot.store(TOMBSTONE, std::memory_order_release);
+                    current->tombstoneCount++;
+                    elementCount--;
+                    waitForReaders();
+                    delete slot;
+                    return true;
+                }
+                location = (location+1) & (current->bucketCount-1);
+            }
+        }
+
+        /**
+         * @brief Finds the value of a key without locking. Returns nullptr if it does not exist.
+         *      The pointer stays valid until the key is erased. If another thread may erase it, use visit() or hold a ReadGuard
+         *      for as long as the pointer is used.
+         *
+         * @param key
+         * @return Value*
+         */
+        Value* find(const Key& key)
+        {
+            uint64_t hash = hasher(key);
+            ReadGuard guard(*this);
+            Slot* slot = search(layout.load(std::memory_order_acquire), hash, key);
+            return (slot != nullptr) ? &slot->value : nullptr;
+        }
+
+        bool contains(const Key& key)
+        {
+            return find(key) != nullptr;
+        }
+
+        /**
+         * @brief Calls func(Value&) with the value of the key without locking. The value can not be freed until func returns
+         *      even if another thread erases the key. Returns if the key was found.
+         *
+         * @tparam F
+         * @param key
+         * @param func
+         * @return bool
+         */
+        template<typename F>
+        bool visit(const Key& key, F&& func)
+        {
+            uint64_t hash = hasher(key);
+            ReadGuard guard(*this);
+            Slot* slot = search(layout.load(std::memory_order_acquire), hash, key);
+            if(slot == nullptr)
+                return false;
+            func(slot->value);
+            return true;
+        }
+
+        /**
+         * @brief Calls func(const Key&, Value&) for every element without locking.
+         *      Keys inserted or erased by other threads during the walk may or may not be included.
+         *
+         * @tparam F
+         * @param func
+         */
+        template<typename F>
+        void forEach(F&& func)
+        {
+            ReadGuard guard(*this);
+            Layout* current = layout.load(std::memory_order_acquire);
+            for(size_t i=0; i<current->bucketCount; i++)
+            {
+                Slot* slot = current->buckets[i].slot.load(std::memory_order_acquire);
+                if(slot != nullptr && slot != TOMBSTONE)
+                    func(slot->key, slot->value);
+            }
+        }
+
+        /**
+         * @brief Gets the number of keys. Only exact while no writer is running.
+         *
+         * @return uint64_t
+         */
+        uint64_t size()
+        {
+            std::lock_guard<std::mutex> lock(writerMutex);
+            return elementCount;
+        }
+
+        uint64_t getTotalBuckets()
+        {
+            return layout.load(std::memory_order_acquire)->bucketCount;
+        }
+
+    private:
+        struct Bucket
+        {
+            std::atomic<Slot*> slot = nullptr; //nullptr == empty. TOMBSTONE == erased
+            uint64_t hash = 0;
+        };
+
+        struct Layout
+        {
+            Layout(size_t bucketCount) : buckets(new Bucket[bucketCount]), bucketCount(bucketCount) {}
+
+            std::unique_ptr<Bucket[]> buckets;
+            size_t bucketCount = 0;
+            size_t tombstoneCount = 0;
+        };
+
+        //each counter is on its own cache line so readers on different threads do not slow each other down
+        struct alignas(64) ReaderSlot
+        {
+            std::atomic<uint64_t> counts[2] = {}; //readers in even and odd epochs
+        };
+
+        static constexpr double MAX_LOAD = 0.7; //includes tombstones
+        static constexpr size_t READER_SLOTS = 64;
+        inline static Slot* const TOMBSTONE = (Slot*)alignof(Slot);
+
+        //threads share slots once there are more than READER_SLOTS of them which only makes writers wait on more readers
+        static size_t getReaderSlot()
+        {
+            static std::atomic<size_t> nextReaderSlot = 0;
+            thread_local size_t readerSlot = nextReaderSlot++ % READER_SLOTS;
+            return readerSlot;
+        }
+
+        Slot* search(Layout* current, uint64_t hash, const Key& key)
+        {
+            size_t location = hash & (current->bucketCount-1);
+            while(true)
+            {
+                Slot* slot = current->buckets[location].slot.load(std::memory_order_acquire);
+                if(slot == nullptr)
+                    return nullptr;
+                if(slot != TOMBSTONE && current->buckets[location].hash == hash && keyEqualFunc(slot->key, key))
+                    return slot;
+                location = (location+1) & (current->bucketCount-1);
+            }
+        }
+
+        //builds a new layout without tombstones and publishes it. Slots are shared so values do not move.
+        Layout* rehash(size_t neededCount)
+        {
+            Layout* old = layout.load(std::memory_order_relaxed);
+            size_t bucketCount = 1024;
+            while(neededCount >= bucketCount*MAX_LOAD)
+                bucketCount *= 2;
+
+            Layout* replacement = new Layout(bucketCount);
+            for(size_t i=0; i<old->bucketCount; i++)
+            {
+                Slot* slot = old->buckets[i].slot.load(std::memory_order_relaxed);
+                if(slot == nullptr || slot == TOMBSTONE)
+                    continue;
+                size_t location = old->buckets[i].hash & (bucketCount-1);
+                while(replacement->buckets[location].slot.load(std::memory_order_relaxed) != nullptr)
+                    location = (location+1) & (bucketCount-1);
+                replacement->buckets[location].hash = old->buckets[i].hash;
+                replacement->buckets[location].slot.store(slot, std::memory_order_relaxed);
+            }
+
+            layout.store(replacement, std::memory_order_release);
+            waitForReaders();
+            delete old;
+            return replacement;
+        }
+
+        //waitForReaders() would wait for the calling thread's own guard. Checked before anything is changed.
+        void throwIfReading()
+        {
+            for(const ReadGuard* guard = innermostGuard; guard != nullptr; guard = guard->previous)
+            {
+                if(&guard->map == this)
+                    throw std::runtime_error("WRITER HOLDS A READ GUARD ON THE SAME MAP");
+            }
+        }
+
+        //returns once every reader that started before this call has finished. Only called by the writer.
+        void waitForReaders()
+        {
+            //seq_cst to pair with the ReadGuard constructor. See there.
+            uint64_t oldParity = epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+            for(ReaderSlot& reader : readers)
+            {
+                while(reader.counts[oldParity].load(std::memory_order_seq_cst) != 0)
+                    std::this_thread::yield();
+            }
+        }
+
+        std::atomic<Layout*> layout = nullptr;
+        uint64_t elementCount = 0;
+        std::mutex writerMutex;
+
+        mutable std::atomic<uint64_t> epoch = 0;
+        mutable ReaderSlot readers[READER_SLOTS];
+        inline static thread_local const ReadGuard* innermostGuard = nullptr; //newest guard held by this thread on any map of this type
+
+        HashFunc hasher;
+        KeyEqual keyEqualFunc;
+    };
+}
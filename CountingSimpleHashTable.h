@@ -0,0 +1,235 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <algorithm>
+#include <limits>
+
+namespace smpl
+{
+    template<typename Key, typename CountType = uint32_t, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class CountingSimpleHashTable;
+
+    template<typename Key, typename CountType = uint32_t, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    using CountingSimpleHashMap = CountingSimpleHashTable<Key, CountType, HashFunc, KeyEqual, BIG>;
+
+    /**
+     * @brief A map from keys to how many times they were counted. Replaces map[key]++ with increment(key).
+     *      increment() finds or adds the key with a single probe (try_insert()) and updates the count in place.
+     *      Counts are CountType (32 bits by default) so each element is smaller than a map to size_t and they saturate instead of wrapping.
+     *
+     *      Optionally keeps the heaviest hitters (the keys with the largest counts) up to date as counts change so getTopK() only
+     *      looks at heavyHitterCount keys instead of sorting the whole table. A k much smaller than heavyHitterCount still reads every
+     *      tracked key since the largest counts are at the leaves of the heap, so keep heavyHitterCount close to the k that is needed. They are kept in a min heap of heavyHitterCount keys. Like the Space-Saving algorithm,
+     *      a key not in the heap replaces the smallest one once its count is larger. Since the table has the exact count of every key
+     *      and counts only go up, the heap always holds the exact top keys. Keys whose count is not above the smallest tracked count
+     *      (most keys in a skewed stream) never touch the heap.
+     *
+     * @tparam Key
+     * @tparam CountType
+     *      An unsigned integer type.
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename CountType, typename HashFunc, typename KeyEqual, bool BIG>
+    class CountingSimpleHashTable
+    {
+    public:
+        static_assert(std::is_integral_v<CountType> && std::is_unsigned_v<CountType>, "CountType must be an unsigned integer");
+
+        using TableType = SimpleHashTable<Key, CountType, false, HashFunc, KeyEqual, BIG>;
+        using KeyValueType = typename TableType::KeyValueType;
+
+        /**
+         * @brief Construct a new Counting Simple Hash Table.
+         *
+         * @param heavyHitterCount
+         *      Number of the largest counts to track for getTopK(). 0 tracks nothing.
+         */
+        CountingSimpleHashTable(size_t heavyHitterCount = 0)
+        {
+            this->heavyHitterCount = heavyHitterCount;
+            heap.reserve(heavyHitterCount);
+        }
+
+        /**
+         * @brief Adds amount to the count of key (adding the key if needed) and returns the new count.
+         *      The count stops at the largest CountType instead of wrapping around.
+         *
+         * @param key
+         * @param amount
+         * @return CountType
+         */
+        CountType increment(const Key& key, CountType amount = 1)
+        {
+            CountType& count = table.try_insert(key, (CountType)0)->second;
+            count = (count > MAX_COUNT - amount) ? MAX_COUNT : count + amount;
+            totalCount += amount;
+            if(heavyHitterCount != 0 && (heap.size() < heavyHitterCount || count > heap[0].second))
+                updateHeavyHitter(key, count);
+            return count;
+        }
+
+        /**
+         * @brief Increments every key in [first, last) by 1.
+         *
+         * @tparam InputIt
+         * @param first
+         * @param last
+         */
+        template<typename InputIt>
+        void incrementAll(InputIt first, InputIt last)
+        {
+            for(; first != last; ++first)
+                increment(*first);
+        }
+
+        /**
+         * @brief Gets the count of a key. 0 if it was never counted.
+         *
+         * @param key
+         * @return CountType
+         */
+        CountType get(const Key& key)
+        {
+            auto it = table.find(key);
+            return (it == table.end()) ? 0 : it->second;
+        }
+
+        /**
+         * @brief Gets the k largest counts (or all tracked ones if there are fewer) from largest to smallest.
+         *      O(heavyHitterCount * log(k)) time and only k keys are copied.
+         *      Throws std::runtime_error if heavy hitters are not tracked or k is more than the number tracked.
+         *
+         * @param k
+         * @return std::vector<KeyValueType>
+         */
+        std::vector<KeyValueType> getTopK(size_t k)
+        {
+            if(k > heavyHitterCount)
+                throw std::runtime_error("K IS MORE THAN THE TRACKED HEAVY HITTERS");
+            //filled with copies first so Key does not need a default constructor. partial_sort_copy() overwrites them.
+            std::vector<KeyValueType> result(heap.begin(), heap.begin() + __min(k, heap.size()));
+            std::partial_sort_copy(heap.begin(), heap.end(), result.begin(), result.end(), [](const KeyValueType& a, const KeyValueType& b)
+            {
+                return a.second > b.second;
+            });
+            return result;
+        }
+
+        /**
+         * @brief Gets the number of distinct keys counted.
+         *
+         * @return uint64_t
+         */
+        uint64_t size()
+        {
+            return table.size();
+        }
+
+        /**
+         * @brief Gets the sum of every amount added (not saturated).
+         *
+         * @return uint64_t
+         */
+        uint64_t getTotalCount()
+        {
+            return totalCount;
+        }
+
+        size_t getHeavyHitterCount()
+        {
+            return heavyHitterCount;
+        }
+
+        /**
+         * @brief Gets the table for reading. Changing counts through it directly is not reflected in the heavy hitters.
+         *
+         * @return TableType&
+         */
+        TableType& getTable()
+        {
+            return table;
+        }
+
+        void clear()
+        {
+            table.clear();
+            heap.clear();
+            heapPositions.clear();
+            totalCount = 0;
+        }
+
+    private:
+        static constexpr CountType MAX_COUNT = std::numeric_limits<CountType>::max();
+
+        //count only went up so the key can only move toward the leaves of the min heap
+        void updateHeavyHitter(const Key& key, CountType count)
+        {
+            auto it = heapPositions.find(key);
+            if(it != heapPositions.end())
+            {
+                heap[it->second].second = count;
+                siftDown(it->second);
+                return;
+            }
+
+            if(heap.size() < heavyHitterCount)
+            {
+                heap.emplace_back(key, count);
+                heapPositions.insert({key, (uint32_t)(heap.size()-1)});
+                siftUp(heap.size()-1);
+                return;
+            }
+
+            //replace the smallest tracked count (Space-Saving)
+            heapPositions.erase(heap[0].first);
+            heap[0] = KeyValueType(key, count);
+            heapPositions.insert({key, (uint32_t)0});
+            siftDown(0);
+        }
+
+        void siftUp(size_t index)
+        {
+            while(index > 0)
+            {
+                size_t parent = (index-1) / 2;
+                if(heap[parent].second <= heap[index].second)
+                    return;
+                swapHeapEntries(parent, index);
+                index = parent;
+            }
+        }
+
+        void siftDown(size_t index)
+        {
+            while(true)
+            {
+                size_t smallest = index;
+                size_t left = 2*index + 1;
+                size_t right = left + 1;
+                if(left < heap.size() && heap[left].second < heap[smallest].second)
+                    smallest = left;
+                if(right < heap.size() && heap[right].second < heap[smallest].second)
+                    smallest = right;
+                if(smallest == index)
+                    return;
+                swapHeapEntries(smallest, index);
+                index = smallest;
+            }
+        }
+
+        void swapHeapEntries(size_t a, size_t b)
+        {
+            std::swap(heap[a], heap[b]);
+            heapPositions.find(heap[a].first)->second = (uint32_t)a;
+            heapPositions.find(heap[b].first)->second = (uint32_t)b;
+        }
+
+        TableType table;
+        uint64_t totalCount = 0;
+
+        size_t heavyHitterCount = 0;
+        std::vector<KeyValueType> heap; //min heap by count of the tracked keys
+        SimpleHashMap<Key, uint32_t, HashFunc, KeyEqual, BIG> heapPositions; //index of each tracked key in heap
+    };
+}
@@ -0,0 +1,467 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <memory>
+
+namespace smpl
+{
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class CowSimpleHashTable;
+
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    using CowSimpleHashMap = CowSimpleHashTable<Key, Value, HashFunc, KeyEqual, BIG>;
+
+    template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    using CowSimpleHashSet = CowSimpleHashTable<Key, void, HashFunc, KeyEqual, BIG>;
+
+    /**
+     * @brief A hash table that can take O(1) snapshots for consistent iteration while it keeps being written to.
+     *      Uses the same layout as SimpleHashTable (fingerprints, redirects and a packed element array) but every array is split into
+     *      fixed size chunks that are reference counted. A snapshot shares every chunk with the table.
+     *      Writes copy a chunk only if a snapshot still uses it so, while a snapshot is alive, each write costs at most a copy of the chunks it touches.
+     *      With no snapshots alive nothing is copied.
+     *
+     *      snapshot() must be called from the thread writing to the table. The snapshot it returns never changes and can be read
+     *      (even on another thread) while the table is written to.
+     *      Elements must be copyable since chunks shared with a snapshot are copied before being changed.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename Value, typename HashFunc, typename KeyEqual, bool BIG>
+    class CowSimpleHashTable
+    {
+    public:
+        using TableType = SimpleHashTable<Key, Value, false, HashFunc, KeyEqual, BIG>;
+        using RedirectType = typename TableType::RedirectType;
+        using HashRedirectPair = typename TableType::HashRedirectPair;
+        using KeyValueType = typename TableType::KeyValueType;
+
+    private:
+        static const size_t BUCKET_CHUNK_SIZE = 4096;
+        static const size_t ELEMENT_CHUNK_SIZE = 1024;
+
+        struct BucketChunk
+        {
+            uint8_t fastHashInfo[BUCKET_CHUNK_SIZE] = {};
+            HashRedirectPair redirectInfo[BUCKET_CHUNK_SIZE] = {};
+        };
+
+        //reserved up front so adding elements never moves the ones already in the chunk
+        struct ElementChunk
+        {
+            ElementChunk()
+            {
+                elements.reserve(ELEMENT_CHUNK_SIZE);
+            }
+            ElementChunk(const ElementChunk& other)
+            {
+                elements.reserve(ELEMENT_CHUNK_SIZE);
+                elements.insert(elements.end(), other.elements.begin(), other.elements.end());
+            }
+            std::vector<KeyValueType> elements;
+        };
+
+        //everything a snapshot needs. Shared until the table changes after a snapshot.
+        struct State
+        {
+            std::vector<std::shared_ptr<BucketChunk>> buckets;
+            std::vector<std::shared_ptr<ElementChunk>> elements;
+            uint64_t bucketCount = 0;
+            uint64_t elementCount = 0;
+        };
+
+    public:
+        /**
+         * @brief Forward iterator over the elements of a table or snapshot. Elements are in insertion order until something is erased.
+         *
+         */
+        class ConstIterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = KeyValueType;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+
+            ConstIterator(){}
+            ConstIterator(const State* state, uint64_t index)
+            {
+                this->state = state;
+                this->index = index;
+            }
+
+            reference operator*() const
+            {
+                return state->elements[index / ELEMENT_CHUNK_SIZE]->elements[index % ELEMENT_CHUNK_SIZE];
+            }
+            pointer operator->() const
+            {
+                return &**this;
+            }
+            ConstIterator& operator++()
+            {
+                index++;
+                return *this;
+            }
+            ConstIterator operator++(int)
+            {
+                ConstIterator temp = *this;
+                index++;
+                return temp;
+            }
+            friend bool operator==(const ConstIterator& a, const ConstIterator& b)
+            {
+                return a.index == b.index && a.state == b.state;
+            }
+            friend bool operator!=(const ConstIterator& a, const ConstIterator& b)
+            {
+                return !(a == b);
+            }
+
+        private:
+            const State* state = nullptr;
+            uint64_t index = 0;
+        };
+
+        /**
+         * @brief A read only view of the table at the moment snapshot() was called.
+         *      Stays valid and unchanged no matter what happens to the table afterwards, including the table being destroyed.
+         *
+         */
+        class Snapshot
+        {
+        public:
+            Snapshot(){}
+
+            ConstIterator begin() const
+            {
+                return ConstIterator(state.get(), 0);
+            }
+            ConstIterator end() const
+            {
+                return ConstIterator(state.get(), state ? state->elementCount : 0);
+            }
+            uint64_t size() const
+            {
+                return state ? state->elementCount : 0;
+            }
+
+            /**
+             * @brief Attempts to find the key as it was when the snapshot was taken. Returns nullptr if it did not exist.
+             *
+             * @param key
+             * @return const KeyValueType*
+             */
+            const KeyValueType* find(const Key& key) const
+            {
+                if(!state)
+                    return nullptr;
+                uint64_t index = CowSimpleHashTable::searchState(*state, key, HashFunc()(key), KeyEqual());
+                return (index == NOT_FOUND) ? nullptr : &*ConstIterator(state.get(), index);
+            }
+
+        private:
+            friend class CowSimpleHashTable;
+            Snapshot(std::shared_ptr<const State> state) : state(std::move(state)) {}
+            std::shared_ptr<const State> state;
+        };
+
+        CowSimpleHashTable()
+        {
+            state = std::make_shared<State>();
+        }
+
+        CowSimpleHashTable(const CowSimpleHashTable& other) = delete;
+        CowSimpleHashTable& operator=(const CowSimpleHashTable& other) = delete;
+
+        /**
+         * @brief Takes a snapshot of the table in O(1).
+         *
+         * @return Snapshot
+         */
+        Snapshot snapshot()
+        {
+            return Snapshot(state);
+        }
+
+        /**
+         * @brief Attempts to insert into the hash table. Returns false if the key already exists.
+         *
+         * @param v
+         * @return bool
+         */
+        bool insert(const KeyValueType& v)
+        {
+            const Key& key = getKey(v);
+            uint64_t actualHash = hasher(key);
+            uint64_t location = findLocation(key, actualHash);
+            if(getHashInfo(*state, location) != 0)
+                return false;
+
+            State& s = getUniqueState();
+            uint64_t index = s.elementCount;
+            if(index % ELEMENT_CHUNK_SIZE == 0)
+                s.elements.push_back(std::make_shared<ElementChunk>());
+            getUniqueElementChunk(index / ELEMENT_CHUNK_SIZE).elements.push_back(v);
+            s.elementCount++;
+
+            BucketChunk& chunk = getUniqueBucketChunk(location / BUCKET_CHUNK_SIZE);
+            chunk.fastHashInfo[location % BUCKET_CHUNK_SIZE] = TableType::extractPartialHash(actualHash);
+            chunk.redirectInfo[location % BUCKET_CHUNK_SIZE] = {(RedirectType)actualHash, (RedirectType)index};
+
+            if(s.elementCount >= s.bucketCount*MAX_LOAD)
+                rebuildBuckets(s.bucketCount*2);
+            return true;
+        }
+
+        /**
+         * @brief Inserts the key or replaces its value if it already exists. Only for maps.
+         *
+         * @param key
+         * @param value
+         */
+        template<typename Q = Value, std::enable_if_t<!std::is_same_v<void, Q>, bool> = true>
+        void insert_or_assign(const Key& key, const Q& value)
+        {
+            uint64_t location = findLocation(key, hasher(key));
+            if(getHashInfo(*state, location) == 0)
+            {
+                insert(KeyValueType(key, value));
+                return;
+            }
+            getUniqueState();
+            uint64_t index = getRedirect(*state, location).second;
+            getUniqueElementChunk(index / ELEMENT_CHUNK_SIZE).elements[index % ELEMENT_CHUNK_SIZE].second = value;
+        }
+
+        /**
+         * @brief Removes the key if it exists. Returns if anything was removed.
+         *      The last element is moved into the removed element's spot.
+         *
+         * @param key
+         * @return bool
+         */
+        bool erase(const Key& key)
+        {
+            uint64_t hole = findLocation(key, hasher(key));
+            if(getHashInfo(*state, hole) == 0)
+                return false;
+
+            State& s = getUniqueState();
+            uint64_t removedIndex = getRedirect(s, hole).second;
+            clearBucket(hole);
+
+            //backward shift so no tombstones are needed
+            uint64_t next = (hole+1) % s.bucketCount;
+            while(getHashInfo(s, next) != 0)
+            {
+                uint64_t desired = getRedirect(s, next).first % s.bucketCount;
+                uint64_t distanceFromDesired = (next + s.bucketCount - desired) % s.bucketCount;
+                uint64_t distanceToHole = (next + s.bucketCount - hole) % s.bucketCount;
+                if(distanceFromDesired >= distanceToHole)
+                {
+                    setBucket(hole, getHashInfo(s, next), getRedirect(s, next));
+                    clearBucket(next);
+                    hole = next;
+                }
+                next = (next+1) % s.bucketCount;
+            }
+
+            uint64_t lastIndex = s.elementCount - 1;
+            if(removedIndex != lastIndex)
+            {
+                KeyValueType& last = getUniqueElementChunk(lastIndex / ELEMENT_CHUNK_SIZE).elements.back();
+                uint64_t lastLocation = findLocation(getKey(last), hasher(getKey(last)));
+                getUniqueElementChunk(removedIndex / ELEMENT_CHUNK_SIZE).elements[removedIndex % ELEMENT_CHUNK_SIZE] = std::move(last);
+                HashRedirectPair redirect = getRedirect(s, lastLocation);
+                redirect.second = (RedirectType)removedIndex;
+                setBucket(lastLocation, getHashInfo(s, lastLocation), redirect);
+            }
+            getUniqueElementChunk(lastIndex / ELEMENT_CHUNK_SIZE).elements.pop_back();
+            if(lastIndex % ELEMENT_CHUNK_SIZE == 0)
+                s.elements.pop_back();
+            s.elementCount--;
+            return true;
+        }
+
+        /**
+         * @brief Attempts to find an element by its Key. Returns nullptr if it does not exist.
+         *      The pointer is invalidated by the next change to the table.
+         *
+         * @param key
+         * @return const KeyValueType*
+         */
+        const KeyValueType* find(const Key& key)
+        {
+            uint64_t index = searchState(*state, key, hasher(key), keyEqualFunc);
+            return (index == NOT_FOUND) ? nullptr : &*ConstIterator(state.get(), index);
+        }
+
+        bool contains(const Key& key)
+        {
+            return searchState(*state, key, hasher(key), keyEqualFunc) != NOT_FOUND;
+        }
+
+        /**
+         * @brief Removes everything. Snapshots taken before keep their elements.
+         *
+         */
+        void clear()
+        {
+            state = std::make_shared<State>();
+        }
+
+        ConstIterator begin()
+        {
+            return ConstIterator(state.get(), 0);
+        }
+
+        ConstIterator end()
+        {
+            return ConstIterator(state.get(), state->elementCount);
+        }
+
+        uint64_t size()
+        {
+            return state->elementCount;
+        }
+
+        uint64_t getTotalBuckets()
+        {
+            return state->bucketCount;
+        }
+
+    private:
+        static constexpr double MAX_LOAD = 0.8;
+        static const uint64_t NOT_FOUND = UINT64_MAX;
+
+        static const Key& getKey(const KeyValueType& v)
+        {
+            if constexpr(std::is_same_v<Key, KeyValueType>)
+                return v;
+            else
+                return v.first;
+        }
+
+        static uint8_t getHashInfo(const State& s, uint64_t location)
+        {
+            return s.buckets[location / BUCKET_CHUNK_SIZE]->fastHashInfo[location % BUCKET_CHUNK_SIZE];
+        }
+
+        static const HashRedirectPair& getRedirect(const State& s, uint64_t location)
+        {
+            return s.buckets[location / BUCKET_CHUNK_SIZE]->redirectInfo[location % BUCKET_CHUNK_SIZE];
+        }
+
+        static const KeyValueType& getElement(const State& s, uint64_t index)
+        {
+            return s.elements[index / ELEMENT_CHUNK_SIZE]->elements[index % ELEMENT_CHUNK_SIZE];
+        }
+
+        //returns the bucket holding the key or the empty bucket where it would go
+        uint64_t findLocation(const Key& key, uint64_t actualHash)
+        {
+            if(state->bucketCount == 0)
+                rebuildBuckets(1024);
+            uint8_t partialHash = TableType::extractPartialHash(actualHash);
+            RedirectType extraHash = (RedirectType)actualHash;
+            uint64_t location = actualHash % state->bucketCount;
+            while(getHashInfo(*state, location) != 0)
+            {
+                const HashRedirectPair& redirect = getRedirect(*state, location);
+                if(getHashInfo(*state, location) == partialHash && redirect.first == extraHash
+                    && keyEqualFunc(getKey(getElement(*state, redirect.second)), key))
+                    return location;
+                location = (location+1) % state->bucketCount;
+            }
+            return location;
+        }
+
+        static uint64_t searchState(const State& s, const Key& key, uint64_t actualHash, const KeyEqual& keyEqual)
+        {
+            if(s.elementCount == 0)
+                return NOT_FOUND;
+            uint8_t partialHash = TableType::extractPartialHash(actualHash);
+            RedirectType extraHash = (RedirectType)actualHash;
+            uint64_t location = actualHash % s.bucketCount;
+            while(getHashInfo(s, location) != 0)
+            {
+                const HashRedirectPair& redirect = getRedirect(s, location);
+                if(getHashInfo(s, location) == partialHash && redirect.first == extraHash
+                    && keyEqual(getKey(getElement(s, redirect.second)), key))
+                    return redirect.second;
+                location = (location+1) % s.bucketCount;
+            }
+            return NOT_FOUND;
+        }
+
+        //copies the list of chunks if a snapshot still uses it. The chunks themselves are copied only when changed.
+        State& getUniqueState()
+        {
+            if(state.use_count() > 1)
+                state = std::make_shared<State>(*state);
+            return *state;
+        }
+
+        BucketChunk& getUniqueBucketChunk(size_t chunkIndex)
+        {
+            std::shared_ptr<BucketChunk>& chunk = state->buckets[chunkIndex];
+            if(chunk.use_count() > 1)
+                chunk = std::make_shared<BucketChunk>(*chunk);
+            return *chunk;
+        }
+
+        ElementChunk& getUniqueElementChunk(size_t chunkIndex)
+        {
+            std::shared_ptr<ElementChunk>& chunk = state->elements[chunkIndex];
+            if(chunk.use_count() > 1)
+                chunk = std::make_shared<ElementChunk>(*chunk);
+            return *chunk;
+        }
+
+        void setBucket(uint64_t location, uint8_t hashInfo, const HashRedirectPair& redirect)
+        {
+            HashRedirectPair copy = redirect; //redirect may point into the chunk being replaced
+            BucketChunk& chunk = getUniqueBucketChunk(location / BUCKET_CHUNK_SIZE);
+            chunk.fastHashInfo[location % BUCKET_CHUNK_SIZE] = hashInfo;
+            chunk.redirectInfo[location % BUCKET_CHUNK_SIZE] = copy;
+        }
+
+        void clearBucket(uint64_t location)
+        {
+            getUniqueBucketChunk(location / BUCKET_CHUNK_SIZE).fastHashInfo[location % BUCKET_CHUNK_SIZE] = 0;
+        }
+
+        //Builds new bucket chunks from the stored hashes. Snapshots keep the old ones.
+        void rebuildBuckets(uint64_t newSize)
+        {
+            State& s = getUniqueState();
+            std::vector<std::shared_ptr<BucketChunk>> newBuckets((newSize + BUCKET_CHUNK_SIZE - 1) / BUCKET_CHUNK_SIZE);
+            for(std::shared_ptr<BucketChunk>& chunk : newBuckets)
+                chunk = std::make_shared<BucketChunk>();
+
+            for(uint64_t i=0; i<s.bucketCount; i++)
+            {
+                uint8_t hashInfo = getHashInfo(s, i);
+                if(hashInfo == 0)
+                    continue;
+                const HashRedirectPair& redirect = getRedirect(s, i);
+                uint64_t location = redirect.first % newSize;
+                while(newBuckets[location / BUCKET_CHUNK_SIZE]->fastHashInfo[location % BUCKET_CHUNK_SIZE] != 0)
+                    location = (location+1) % newSize;
+                newBuckets[location / BUCKET_CHUNK_SIZE]->fastHashInfo[location % BUCKET_CHUNK_SIZE] = hashInfo;
+                newBuckets[location / BUCKET_CHUNK_SIZE]->redirectInfo[location % BUCKET_CHUNK_SIZE] = redirect;
+            }
+            s.buckets = std::move(newBuckets);
+            s.bucketCount = newSize;
+        }
+
+        std::shared_ptr<State> state;
+        HashFunc hasher;
+        KeyEqual keyEqualFunc;
+    };
+}
@@ -0,0 +1,390 @@
+#pragma once
+#include "SimpleHashTable.h"
+
+namespace smpl
+{
+    /**
+     * @brief The changes needed to make one table equal to another. See DigestSimpleHashTable::diff()
+     *
+     * @tparam KeyValueType
+     * @tparam Key
+     */
+    template<typename KeyValueType, typename Key>
+    struct SimpleHashDigestDelta
+    {
+        std::vector<KeyValueType> upserts; //missing or different in the other table
+        std::vector<Key> erases; //only in the other table
+
+        bool empty() const
+        {
+            return upserts.empty() && erases.empty();
+        }
+    };
+
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false, typename ValueHash = TestHashFunction<Value>>
+    class DigestSimpleHashTable;
+
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false, typename ValueHash = TestHashFunction<Value>>
+    using DigestSimpleHashMap = DigestSimpleHashTable<Key, Value, HashFunc, KeyEqual, BIG, ValueHash>;
+
+    template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    using DigestSimpleHashSet = DigestSimpleHashTable<Key, void, HashFunc, KeyEqual, BIG, void>;
+
+    /**
+     * @brief A hash table that keeps an order independent digest of its contents up to date as it changes.
+     *      Two tables with the same elements have the same digest no matter what order things were inserted or erased in
+     *      so checking that two replicas match is O(1).
+     *
+     *      The digest is the sum of a mixed hash of every element (key and value). Elements are also split into 2^getRangeBits() ranges
+     *      by the low bits of their key hash and each range keeps its own sum. getRangeDigests() combines ranges into fewer, larger ones
+     *      (a Merkle tree over the hash ranges) so a remote replica can narrow down where they differ one level at a time.
+     *      diff() uses the ranges to only look at the elements in ranges that do not match.
+     *
+     *      The number of ranges grows and shrinks with the table so there are about ELEMENTS_PER_RANGE elements in each.
+     *      Changing it recomputes the range digests which costs as much as hashing every key once (like a rehash).
+     *      diff() compares every range digest (8 bytes each, O(n / ELEMENTS_PER_RANGE)) then looks at about ELEMENTS_PER_RANGE
+     *      elements in each table for every range that differs, so the cost of the elements compared is O(delta).
+     *
+     *      The ranges use the same low bits the table uses to pick home buckets so the elements of one range are found by walking
+     *      only the bucket runs that start in it. In small or dense mode the elements are not in hash order so every element is
+     *      hashed once per diff() instead (O(n)).
+     *
+     *      Replicas must use the same HashFunc and ValueHash (including any seed).
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     * @tparam ValueHash
+     *      Hashes values for the digest. Unused for sets.
+     */
+    template<typename Key, typename Value, typename HashFunc, typename KeyEqual, bool BIG, typename ValueHash>
+    class DigestSimpleHashTable
+    {
+    public:
+        using TableType = SimpleHashTable<Key, Value, false, HashFunc, KeyEqual, BIG>;
+        using KeyValueType = typename TableType::KeyValueType;
+        using Delta = SimpleHashDigestDelta<KeyValueType, Key>;
+
+        static constexpr size_t MIN_RANGE_BITS = 10; //no more ranges than the smallest number of buckets a table has
+        static constexpr size_t ELEMENTS_PER_RANGE = 64;
+
+        DigestSimpleHashTable()
+        {
+            rangeDigests = std::vector<uint64_t>((size_t)1 << rangeBits);
+        }
+
+        /**
+         * @brief Takes over an existing table (like one from SimpleHashTable::load()) and computes its digest.
+         *
+         * @param existing
+         */
+        DigestSimpleHashTable(TableType&& existing) : table(std::move(existing))
+        {
+            rangeDigests = std::vector<uint64_t>((size_t)1 << rangeBits);
+            for(const KeyValueType& v : table)
+                addDigest(table.hashKey(getKey(v)), v, 1);
+            resizeRanges();
+        }
+
+        /**
+         * @brief Attempts to insert into the table. Returns false if the key already exists.
+         *
+         * @param v
+         * @return bool
+         */
+        bool insert(const KeyValueType& v)
+        {
+            uint64_t hash = table.hashKey(getKey(v));
+            uint64_t sizeBefore = table.size();
+            table.insertHashed(hash, KeyValueType(v));
+            if(table.size() == sizeBefore)
+                return false;
+            addDigest(hash, v, 1);
+            checkRangeCount();
+            return true;
+        }
+
+        /**
+         * @brief Inserts the key or replaces its value if it already exists. Only for maps.
+         *
+         * @param key
+         * @param value
+         */
+        template<typename Q = Value, std::enable_if_t<!std::is_same_v<void, Q>, bool> = true>
+        void insert_or_assign(const Key& key, const Q& value)
+        {
+            uint64_t hash = table.hashKey(key);
+            auto it = table.find(key);
+            if(it == table.end())
+            {
+                KeyValueType v(key, value);
+                addDigest(hash, v, 1);
+                table.insertHashed(hash, std::move(v));
+                checkRangeCount();
+                return;
+            }
+            addDigest(hash, *it, -1);
+            it->second = value;
+            addDigest(hash, *it, 1);
+        }
+
+        /**
+         * @brief Removes the key if it exists. Returns if anything was removed.
+         *
+         * @param key
+         * @return bool
+         */
+        bool erase(const Key& key)
+        {
+            auto it = table.find(key);
+            if(it == table.end())
+                return false;
+            addDigest(table.hashKey(key), *it, -1);
+            table.erase(it);
+            checkRangeCount();
+            return true;
+        }
+
+        const KeyValueType* find(const Key& key)
+        {
+            auto it = table.find(key);
+            if(it == table.end())
+                return nullptr;
+            return &*it;
+        }
+
+        bool contains(const Key& key)
+        {
+            return table.find(key) != table.end();
+        }
+
+        uint64_t size()
+        {
+            return table.size();
+        }
+
+        /**
+         * @brief Gets the table for reading. Changes made through it directly are not included in the digest.
+         *
+         * @return TableType&
+         */
+        TableType& getTable()
+        {
+            return table;
+        }
+
+        /**
+         * @brief Gets the digest of every element. Equal tables always have equal digests.
+         *
+         * @return uint64_t
+         */
+        uint64_t getDigest()
+        {
+            return digest;
+        }
+
+        /**
+         * @brief Gets the number of bits of the key hash used for the finest ranges. Replicas of different sizes may have
+         *      different values. Compare them at the smaller level.
+         *
+         * @return size_t
+         */
+        size_t getRangeBits()
+        {
+            return rangeBits;
+        }
+
+        /**
+         * @brief Gets the digests of the hash ranges at one level of the Merkle tree.
+         *      Level 0 is a single range (the same as getDigest()). Each level splits every range of the level before it in 2.
+         *      Range i of level l holds the keys whose hash has i as its low l bits so it covers the ranges i and i + 2^l of the next level.
+         *      Levels past getRangeBits() are the same as getRangeBits().
+         *
+         * @param level
+         * @return std::vector<uint64_t>
+         */
+        std::vector<uint64_t> getRangeDigests(size_t level)
+        {
+            level = __min(level, rangeBits);
+            std::vector<uint64_t> result((size_t)1 << level);
+            for(size_t i=0; i<rangeDigests.size(); i++)
+                result[i & (result.size()-1)] += rangeDigests[i];
+            return result;
+        }
+
+        /**
+         * @brief Calls func(const KeyValueType&) for every element in a range of getRangeDigests(level).
+         *      Used to send the elements of ranges that do not match to a remote replica.
+         *
+         * @tparam F
+         * @param level
+         * @param rangeIndex
+         * @param func
+         */
+        template<typename F>
+        void forEachInRange(size_t level, size_t rangeIndex, F&& func)
+        {
+            forEachInRanges(__min(level, rangeBits), {rangeIndex}, func);
+        }
+
+        /**
+         * @brief Finds what has to change in other to make it equal to this table.
+         *      O(1) if the digests match. Otherwise the range digests are compared at the finest level both tables have and
+         *      only the elements in ranges that differ are compared (see the class description for the cost).
+         *
+         * @param other
+         * @return Delta
+         */
+        Delta diff(DigestSimpleHashTable& other)
+        {
+            Delta delta;
+            if(digest == other.digest)
+                return delta;
+
+            size_t level = __min(rangeBits, other.rangeBits);
+            std::vector<uint64_t> mine = getRangeDigests(level);
+            std::vector<uint64_t> theirs = other.getRangeDigests(level);
+            std::vector<size_t> differing;
+            for(size_t i=0; i<mine.size(); i++)
+            {
+                if(mine[i] != theirs[i])
+                    differing.push_back(i);
+            }
+
+            forEachInRanges(level, differing, [&](const KeyValueType& v)
+            {
+                auto it = other.table.find(getKey(v));
+                if(it == other.table.end() || !valuesEqual(*it, v))
+                    delta.upserts.push_back(v);
+            });
+            other.forEachInRanges(level, differing, [&](const KeyValueType& v)
+            {
+                if(table.find(getKey(v)) == table.end())
+                    delta.erases.push_back(getKey(v));
+            });
+            return delta;
+        }
+
+        /**
+         * @brief Applies a Delta from diff() so this table matches the table the delta was computed from.
+         *
+         * @param delta
+         */
+        void applyDelta(const Delta& delta)
+        {
+            for(const Key& key : delta.erases)
+                erase(key);
+            for(const KeyValueType& v : delta.upserts)
+            {
+                if constexpr(std::is_same_v<void, Value>)
+                    insert(v);
+                else
+                    insert_or_assign(v.first, v.second);
+            }
+        }
+
+    private:
+        static const Key& getKey(const KeyValueType& v)
+        {
+            if constexpr(std::is_same_v<Key, KeyValueType>)
+                return v;
+            else
+                return v.first;
+        }
+
+        static bool valuesEqual(const KeyValueType& a, const KeyValueType& b)
+        {
+            if constexpr(std::is_same_v<void, Value>)
+                return true;
+            else
+                return a.second == b.second;
+        }
+
+        static uint64_t getElementDigest(uint64_t keyHash, const KeyValueType& v)
+        {
+            if constexpr(std::is_same_v<void, Value>)
+                return rapid_mix(keyHash, UINT64_C(0x9E3779B97F4A7C15));
+            else
+                return rapid_mix(keyHash ^ UINT64_C(0x9E3779B97F4A7C15), ValueHash()(v.second) ^ UINT64_C(0xD6E8FEB86659FD93));
+        }
+
+        //sign is 1 to add an element and -1 to remove it
+        void addDigest(uint64_t keyHash, const KeyValueType& v, int sign)
+        {
+            uint64_t d = getElementDigest(keyHash, v) * (uint64_t)(int64_t)sign;
+            digest += d;
+            rangeDigests[keyHash & (rangeDigests.size()-1)] += d;
+        }
+
+        //grows at more than ELEMENTS_PER_RANGE per range and shrinks at less than a quarter of that so it does not flip back and forth
+        void checkRangeCount()
+        {
+            uint64_t perRange = table.size() >> rangeBits;
+            if(perRange > ELEMENTS_PER_RANGE || (rangeBits > MIN_RANGE_BITS && perRange < ELEMENTS_PER_RANGE/4))
+                resizeRanges();
+        }
+
+        void resizeRanges()
+        {
+            size_t bits = rangeBits;
+            while((table.size() >> bits) > ELEMENTS_PER_RANGE)
+                bits++;
+            while(bits > MIN_RANGE_BITS && (table.size() >> bits) < ELEMENTS_PER_RANGE/4)
+                bits--;
+            if(bits == rangeBits)
+                return;
+
+            rangeBits = bits;
+            rangeDigests = std::vector<uint64_t>((size_t)1 << rangeBits);
+            for(const KeyValueType& v : table)
+            {
+                uint64_t hash = table.hashKey(getKey(v));
+                rangeDigests[hash & (rangeDigests.size()-1)] += getElementDigest(hash, v);
+            }
+        }
+
+        //calls func for every element in the given ranges of a level
+        template<typename F>
+        void forEachInRanges(size_t level, const std::vector<size_t>& ranges, F&& func)
+        {
+            if(table.arr.size() == 0 || ranges.empty())
+                return;
+            size_t rangeCount = (size_t)1 << level;
+            size_t bucketCount = table.fastHashInfo.size();
+            if(table.isSmall() || table.isDense() || bucketCount % rangeCount != 0)
+            {
+                //not in hash order so every element is hashed once
+                std::vector<uint8_t> wanted(rangeCount);
+                for(size_t r : ranges)
+                    wanted[r] = 1;
+                for(const KeyValueType& v : table.arr)
+                {
+                    if(wanted[table.hashKey(getKey(v)) & (rangeCount-1)])
+                        func(v);
+                }
+                return;
+            }
+
+            //Bucket counts are powers of 2 of at least rangeCount so every home bucket of a range is its index + a multiple of rangeCount.
+            //Linear probing keeps an element in the run of full buckets that starts at its home bucket.
+            for(size_t r : ranges)
+            {
+                for(size_t home=r; home<bucketCount; home+=rangeCount)
+                {
+                    for(size_t location=home; !table.getLocationEmpty(location); location=(location+1) % bucketCount)
+                    {
+                        if(table.getPartialHashEx(location) % bucketCount == home)
+                            func(table.arr[table.getRedirectInfo(location)]);
+                    }
+                }
+            }
+        }
+
+        TableType table;
+        uint64_t digest = 0;
+        size_t rangeBits = MIN_RANGE_BITS;
+        std::vector<uint64_t> rangeDigests;
+    };
+}
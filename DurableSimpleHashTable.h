@@ -0,0 +1,415 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace smpl
+{
+    struct DurableSimpleHashOptions
+    {
+        //Records are buffered in memory and written + synced to disk together once this many bytes are waiting (group commit).
+        //  Anything not synced yet can be lost in a crash. Call sync() to make everything written so far durable.
+        size_t groupCommitBytes = 1<<16;
+
+        //A checkpoint is taken once the log grows past this many bytes. Bounds how much of the log recovery has to replay.
+        //  0 disables automatic checkpoints.
+        uint64_t checkpointBytes = 64ULL<<20;
+    };
+
+    /**
+     * @brief A SimpleHashMap that survives crashes and restarts.
+     *      Every change is appended to a write ahead log (filename + ".wal") and the whole map is checkpointed
+     *      to the snapshot format (filename + ".snap", see SimpleHashTable::save()) once the log gets large enough.
+     *      On open, the last checkpoint is loaded and the log is replayed on top of it. A partially written record at the end of
+     *      the log (from a crash in the middle of a write) is dropped.
+     *
+     *      Writes only append to a memory buffer. The buffer is written and synced in one go every DurableSimpleHashOptions::groupCommitBytes
+     *      or when sync() is called.
+     *
+     *      Keys and values are written as raw bytes when trivially copyable and through SimpleHashSerializer otherwise.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class DurableSimpleHashMap
+    {
+    public:
+        using TableType = SimpleHashMap<Key, Value, HashFunc, KeyEqual, BIG>;
+
+        /**
+         * @brief Opens (or creates) the map stored at filename and recovers its contents.
+         *      Throws std::runtime_error if the files can not be opened or were written by a different type of map.
+         *
+         * @param filename
+         * @param options
+         */
+        DurableSimpleHashMap(const std::string& filename, DurableSimpleHashOptions options = DurableSimpleHashOptions())
+        {
+            this->filename = filename;
+            this->options = options;
+            recover();
+        }
+
+        DurableSimpleHashMap(const DurableSimpleHashMap& other) = delete;
+        DurableSimpleHashMap& operator=(const DurableSimpleHashMap& other) = delete;
+
+        /**
+         * @brief Syncs anything still buffered and closes the log.
+         *
+         */
+        ~DurableSimpleHashMap()
+        {
+            try
+            {
+                sync();
+            }
+            catch(...)
+            {
+            }
+            if(logFile != nullptr)
+                std::fclose(logFile);
+        }
+
+        /**
+         * @brief Inserts the key or replaces its value if it already exists.
+         *
+         * @param key
+         * @param value
+         */
+        void insert_or_assign(const Key& key, const Value& value)
+        {
+            auto it = table.try_insert(key, value);
+            it->second = value;
+
+            beginRecord(RECORD_ASSIGN);
+            appendItem(key);
+            appendItem(value);
+            endRecord();
+        }
+
+        /**
+         * @brief Removes the key if it exists. Returns if anything was removed.
+         *      Nothing is logged if the key did not exist.
+         *
+         * @param key
+         * @return bool
+         */
+        bool erase(const Key& key)
+        {
+            auto it = table.find(key);
+            if(it == table.end())
+                return false;
+            table.erase(it);
+
+            beginRecord(RECORD_ERASE);
+            appendItem(key);
+            endRecord();
+            return true;
+        }
+
+        /**
+         * @brief Attempts to find the value for a key. Returns nullptr if it does not exist.
+         *      Changes must go through insert_or_assign() so they are logged. The pointer is invalidated by any change.
+         *
+         * @param key
+         * @return const Value*
+         */
+        const Value* find(const Key& key)
+        {
+            auto it = table.find(key);
+            if(it == table.end())
+                return nullptr;
+            return &it->second;
+        }
+
+        bool contains(const Key& key)
+        {
+            return table.find(key) != table.end();
+        }
+
+        uint64_t size()
+        {
+            return table.size();
+        }
+
+        /**
+         * @brief Gets the map for reading. Changes made through it directly are not logged.
+         *
+         * @return TableType&
+         */
+        TableType& getTable()
+        {
+            return table;
+        }
+
+        /**
+         * @brief Writes every buffered record to the log and waits until it is on disk.
+         *      Everything before this call survives a crash afterwards.
+         *      Takes a checkpoint if the log has grown past DurableSimpleHashOptions::checkpointBytes.
+         *      Throws std::runtime_error if the records could not be written or flushed to disk.
+         *
+         */
+        void sync()
+        {
+            if(!pending.empty())
+            {
+                if(std::fwrite(pending.data(), 1, pending.size(), logFile) != pending.size())
+                    throw std::runtime_error("LOG WRITE FAILED");
+                logBytes += pending.size();
+                pending.clear();
+                if(!syncFile(logFile))
+                    throw std::runtime_error("LOG WRITE FAILED");
+            }
+
+            if(options.checkpointBytes != 0 && logBytes >= options.checkpointBytes)
+                checkpoint();
+        }
+
+        /**
+         * @brief Saves the whole map as a snapshot and empties the log.
+         *      The snapshot is written to a temporary file that replaces the old snapshot only once it is completely on disk
+         *      so a crash at any point leaves either the old or the new snapshot.
+         *      Throws std::runtime_error if the snapshot could not be written or flushed to disk. The log is kept in that case.
+         *
+         */
+        void checkpoint()
+        {
+            if(!pending.empty())
+            {
+                sync();
+                if(logBytes == 0)
+                    return; //sync() already took the checkpoint
+            }
+
+            std::string tempName = getSnapshotName() + ".tmp";
+            {
+                std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+                table.save(out);
+                out.flush();
+                if(!out)
+                    throw std::runtime_error("SNAPSHOT WRITE FAILED");
+            }
+            std::FILE* tempFile = std::fopen(tempName.c_str(), "rb+");
+            if(tempFile == nullptr)
+                throw std::runtime_error("SNAPSHOT WRITE FAILED");
+            bool synced = syncFile(tempFile);
+            std::fclose(tempFile);
+            if(!synced)
+                throw std::runtime_error("SNAPSHOT WRITE FAILED");
+
+            std::filesystem::rename(tempName, getSnapshotName());
+            syncDirectory();
+
+            //If a crash happens before the log is emptied, the old log gets replayed over the new snapshot.
+            //  That is harmless since every record sets a key to its final state instead of changing it relative to what was there.
+            std::fclose(logFile);
+            logFile = std::fopen(getLogName().c_str(), "wb");
+            if(logFile == nullptr)
+                throw std::runtime_error("COULD NOT OPEN FILE");
+            writeLogHeader();
+        }
+
+    private:
+        static const uint8_t RECORD_ASSIGN = 1;
+        static const uint8_t RECORD_ERASE = 2;
+        static constexpr char LOG_MAGIC[8] = {'S', 'M', 'P', 'L', 'W', 'A', 'L', '1'};
+
+        //Log layout
+        //  magic (8 bytes), key size (4 bytes), value size (4 bytes)
+        //  records: payload size (4 bytes), type (1 byte), payload, rapidhash of type + payload (8 bytes)
+        static const size_t LOG_HEADER_SIZE = sizeof(LOG_MAGIC) + 2*sizeof(uint32_t);
+        static const size_t RECORD_OVERHEAD = sizeof(uint32_t) + 1 + sizeof(uint64_t);
+
+        std::string getSnapshotName()
+        {
+            return filename + ".snap";
+        }
+
+        std::string getLogName()
+        {
+            return filename + ".wal";
+        }
+
+        void beginRecord(uint8_t type)
+        {
+            recordStart = pending.size();
+            pending.append(sizeof(uint32_t), '\0'); //filled in by endRecord()
+            pending.push_back((char)type);
+        }
+
+        void endRecord()
+        {
+            uint32_t payloadSize = (uint32_t)(pending.size() - recordStart - sizeof(uint32_t) - 1);
+            std::memcpy(pending.data() + recordStart, &payloadSize, sizeof(uint32_t));
+            uint64_t checksum = rapidhash(pending.data() + recordStart + sizeof(uint32_t), payloadSize + 1);
+            pending.append((const char*)&checksum, sizeof(checksum));
+
+            if(pending.size() >= options.groupCommitBytes)
+                sync();
+        }
+
+        template<typename T>
+        void appendItem(const T& item)
+        {
+            if constexpr(std::is_trivially_copyable_v<T>)
+                pending.append((const char*)&item, sizeof(T));
+            else
+            {
+                itemStream.str(std::string());
+                SimpleHashSnapshotWriter writer(itemStream);
+                SimpleHashSerializer<T>::write(writer, item);
+                pending += itemStream.str();
+            }
+        }
+
+        void recover()
+        {
+            if(std::filesystem::exists(getSnapshotName()))
+            {
+                std::ifstream in(getSnapshotName(), std::ios::binary);
+                table.load(in);
+            }
+
+            uint64_t validBytes = 0;
+            if(std::filesystem::exists(getLogName()))
+                validBytes = replayLog();
+
+            if(validBytes == 0)
+            {
+                logFile = std::fopen(getLogName().c_str(), "wb");
+                if(logFile == nullptr)
+                    throw std::runtime_error("COULD NOT OPEN FILE");
+                writeLogHeader();
+            }
+            else
+            {
+                //drop anything after the last complete record so new records are not appended after garbage
+                std::filesystem::resize_file(getLogName(), validBytes);
+                logFile = std::fopen(getLogName().c_str(), "ab");
+                if(logFile == nullptr)
+                    throw std::runtime_error("COULD NOT OPEN FILE");
+                logBytes = validBytes - LOG_HEADER_SIZE;
+            }
+        }
+
+        //applies every complete record in the log. Returns the number of bytes that were valid or 0 if the log can't be used.
+        uint64_t replayLog()
+        {
+            std::ifstream in(getLogName(), std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if(data.size() < LOG_HEADER_SIZE)
+                return 0; //crashed while creating the log
+
+            uint32_t sizes[2];
+            std::memcpy(sizes, data.data() + sizeof(LOG_MAGIC), sizeof(sizes));
+            if(std::memcmp(data.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || sizes[0] != sizeof(Key) || sizes[1] != sizeof(Value))
+                throw std::runtime_error("LOG DOES NOT MATCH TABLE TYPE");
+
+            size_t offset = LOG_HEADER_SIZE;
+            while(data.size() - offset >= RECORD_OVERHEAD)
+            {
+                uint32_t payloadSize;
+                std::memcpy(&payloadSize, data.data() + offset, sizeof(uint32_t));
+                if(data.size() - offset - RECORD_OVERHEAD < payloadSize)
+                    break;
+
+                const char* typeAndPayload = data.data() + offset + sizeof(uint32_t);
+                uint64_t checksum;
+                std::memcpy(&checksum, typeAndPayload + 1 + payloadSize, sizeof(checksum));
+                if(rapidhash(typeAndPayload, payloadSize + 1) != checksum)
+                    break;
+
+                if(!applyRecord((uint8_t)typeAndPayload[0], typeAndPayload + 1, payloadSize))
+                    break;
+                offset += RECORD_OVERHEAD + payloadSize;
+            }
+            return offset;
+        }
+
+        bool applyRecord(uint8_t type, const char* payload, size_t payloadSize)
+        {
+            std::istringstream in(std::string(payload, payloadSize));
+            SimpleHashSnapshotReader reader(in);
+            try
+            {
+                Key key = SimpleHashSerializer<Key>::read(reader);
+                if(type == RECORD_ASSIGN)
+                {
+                    Value value = SimpleHashSerializer<Value>::read(reader);
+                    auto it = table.try_insert(key, value);
+                    it->second = std::move(value);
+                }
+                else if(type == RECORD_ERASE)
+                    table.erase(key);
+                else
+                    return false;
+            }
+            catch(std::runtime_error&)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        void writeLogHeader()
+        {
+            uint32_t sizes[2] = {sizeof(Key), sizeof(Value)};
+            std::fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), logFile);
+            std::fwrite(sizes, 1, sizeof(sizes), logFile);
+            if(!syncFile(logFile))
+                throw std::runtime_error("LOG WRITE FAILED");
+            logBytes = 0;
+        }
+
+        //returns false if the data may not have reached the disk
+        static bool syncFile(std::FILE* file)
+        {
+            if(std::fflush(file) != 0)
+                return false;
+#ifdef _WIN32
+            return _commit(_fileno(file)) == 0;
+#else
+            return fsync(fileno(file)) == 0;
+#endif
+        }
+
+        //makes the rename of the snapshot durable. Windows does not need (or allow) this.
+        void syncDirectory()
+        {
+#ifndef _WIN32
+            std::filesystem::path directory = std::filesystem::absolute(getSnapshotName()).parent_path();
+            int fd = ::open(directory.c_str(), O_RDONLY);
+            if(fd < 0)
+                throw std::runtime_error("SNAPSHOT WRITE FAILED");
+            int result = fsync(fd);
+            ::close(fd);
+            if(result != 0)
+                throw std::runtime_error("SNAPSHOT WRITE FAILED");
+#endif
+        }
+
+        TableType table;
+        std::string filename;
+        DurableSimpleHashOptions options;
+
+        std::FILE* logFile = nullptr;
+        uint64_t logBytes = 0; //bytes of records in the log file. Does not include pending
+        std::string pending;
+        size_t recordStart = 0;
+        std::ostringstream itemStream;
+    };
+}
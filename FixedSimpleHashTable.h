@@ -0,0 +1,468 @@
+#pragma once
+#include "ImportantInclude.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifndef LIKELY
+#define LIKELY(x)      __builtin_expect(!!(x), 1)
+#define UNLIKELY(x)    __builtin_expect(!!(x), 0)
+#endif
+
+namespace smpl
+{
+    template<typename Key, typename Value, size_t Capacity, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    class FixedSimpleHashTable;
+
+    template<typename Key, typename Value, size_t Capacity, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    using FixedSimpleHashMap = FixedSimpleHashTable<Key, Value, Capacity, HashFunc, KeyEqual>;
+
+    template<typename Key, size_t Capacity, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    using FixedSimpleHashSet = FixedSimpleHashTable<Key, void, Capacity, HashFunc, KeyEqual>;
+
+    template<typename Key, typename Value, size_t Capacity, typename HashFunc, typename KeyEqual>
+    struct FixedSimpleHashTableIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::conditional_t<std::is_same_v<void, Value>, Key, std::pair<Key, Value>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        FixedSimpleHashTableIterator(){}
+        FixedSimpleHashTableIterator(FixedSimpleHashTable<Key, Value, Capacity, HashFunc, KeyEqual>* ptr, size_t index)
+        {
+            this->ptr = ptr;
+            this->index = index;
+        }
+
+        FixedSimpleHashTableIterator& operator++()
+        {
+            index++;
+            return *this;
+        }
+
+        reference operator*() const
+        {
+            return ptr->data()[index];
+        }
+        pointer operator->() const
+        {
+            return &ptr->data()[index];
+        }
+
+        bool operator==(const FixedSimpleHashTableIterator& other) const
+        {
+            return index == other.index;
+        }
+        bool operator!=(const FixedSimpleHashTableIterator& other) const
+        {
+            return index != other.index;
+        }
+
+    private:
+        friend FixedSimpleHashTable<Key, Value, Capacity, HashFunc, KeyEqual>;
+
+        FixedSimpleHashTable<Key, Value, Capacity, HashFunc, KeyEqual>* ptr = nullptr;
+        size_t index = 0;
+    };
+
+    /**
+     * @brief A hash table that never allocates memory.
+     *      All buckets and elements are stored inside of the object itself so it can live on the stack, in static memory,
+     *      or in any memory provided by the caller (through placement new).
+     *      Uses the same layout as SimpleHashTable. 1 byte fingerprints, stored hash + redirect into a dense array of elements,
+     *      swap and pop deletion with a backward shift of the buckets, and iteration over the dense array.
+     *
+     *      The number of buckets is fixed so the load never exceeds 80% and a rehash never happens.
+     *      Inserting when Capacity elements already exist fails by returning end() instead of allocating or throwing.
+     *
+     * @tparam Capacity
+     *      The maximum number of elements that can be stored at once.
+     */
+    template<typename Key, typename Value, size_t Capacity, typename HashFunc, typename KeyEqual>
+    class FixedSimpleHashTable
+    {
+    public:
+        static_assert(Capacity > 0 && Capacity < UINT32_MAX, "Capacity must fit in the 32 bit redirect");
+
+        using RedirectType = uint32_t;
+        using HashRedirectPair = std::pair<RedirectType, RedirectType>;
+        using KeyValueType = std::conditional_t<std::is_same_v<void, Value>, Key, std::pair<Key, Value>>;
+        using Iterator = FixedSimpleHashTableIterator<Key, Value, Capacity, HashFunc, KeyEqual>;
+
+        /**
+         * @brief Construct a new Fixed Hash Table.
+         *      Nothing is allocated. The table can hold up to Capacity elements.
+         */
+        FixedSimpleHashTable(){}
+
+        ~FixedSimpleHashTable()
+        {
+            clear();
+        }
+
+        FixedSimpleHashTable(const FixedSimpleHashTable& other)
+        {
+            copyFrom(other);
+        }
+        FixedSimpleHashTable& operator=(const FixedSimpleHashTable& other)
+        {
+            if(this != &other)
+            {
+                clear();
+                copyFrom(other);
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Move Construct a new Fixed Hash Table object
+         *      Moves each element since the storage can not be stolen. "other" is left empty.
+         *
+         * @param other
+         */
+        FixedSimpleHashTable(FixedSimpleHashTable&& other) noexcept
+        {
+            moveFrom(std::move(other));
+        }
+        FixedSimpleHashTable& operator=(FixedSimpleHashTable&& other) noexcept
+        {
+            if(this != &other)
+            {
+                clear();
+                moveFrom(std::move(other));
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Destroys all elements and empties the buckets. No memory is released since none was allocated.
+         *
+         */
+        void clear()
+        {
+            for(size_t i=0; i<totalElements; i++)
+                data()[i].~KeyValueType();
+            fastHashInfo.fill(0);
+            totalElements = 0;
+        }
+
+        /**
+         * @brief Attempts to insert into the hash table.
+         *      Returns an iterator to either the newly constructed element or an existing element with the specified key.
+         *      Returns end() if the key does not exist and the table is full.
+         *
+         * @param v
+         * @return Iterator
+         */
+        Iterator insert(const KeyValueType& v)
+        {
+            return emplace(KeyValueType(v));
+        }
+        Iterator insert(KeyValueType&& v)
+        {
+            return emplace(std::move(v));
+        }
+
+        /**
+         * @brief Emplaces into the hash table.
+         *      Returns an iterator to either the newly constructed element or an existing element with the specified key.
+         *      Returns end() if the key does not exist and the table is full. Nothing is constructed in that case.
+         *      Iterators are never invalidated by an insert.
+         *
+         * @param v
+         * @return Iterator
+         */
+        Iterator emplace(KeyValueType&& v)
+        {
+            const Key& key = getKey(v);
+            uint64_t actualHash = hasher(key);
+            uint64_t location = 0;
+            if(locate(actualHash, key, location))
+                return Iterator(this, getRedirectInfo(location));
+
+            if(UNLIKELY(totalElements == Capacity))
+                return end();
+
+            new (&data()[totalElements]) KeyValueType(std::move(v));
+            return addToBucket(location, actualHash);
+        }
+
+        /**
+         * @brief Attempts to either find the provided key or emplace an object with that key constructed from args.
+         *      Returns end() if the key does not exist and the table is full.
+         *
+         * @param key
+         * @param args
+         * @return Iterator
+         */
+        template<typename K, typename... Args>
+        Iterator try_insert(K&& key, Args&&... args)
+        {
+            uint64_t actualHash = hasher(key);
+            uint64_t location = 0;
+            if(locate(actualHash, key, location))
+                return Iterator(this, getRedirectInfo(location));
+
+            if(UNLIKELY(totalElements == Capacity))
+                return end();
+
+            constructInPlace(&data()[totalElements], std::forward<K>(key), std::forward<Args>(args)...);
+            return addToBucket(location, actualHash);
+        }
+
+        /**
+         * @brief Attempts to find an element by its Key.
+         *      If it exists, returns an iterator to it. Otherwise returns an iterator to the end of the hash table.
+         *
+         * @param k
+         * @return Iterator
+         */
+        Iterator find(const Key& k)
+        {
+            uint64_t location = 0;
+            if(locate(hasher(k), k, location))
+                return Iterator(this, getRedirectInfo(location));
+            return end();
+        }
+
+        /**
+         * @brief Attempts to find an element by its Key and remove it.
+         *      The last element in the internal array is moved into the removed spot so iterators to it become invalid.
+         *
+         * @param k
+         * @return true if something was removed.
+         */
+        bool erase(const Key& k)
+        {
+            uint64_t location = 0;
+            if(!locate(hasher(k), k, location))
+                return false;
+            removeAt(location);
+            return true;
+        }
+
+        /**
+         * @brief Removes the element the iterator points to. The iterator MUST be valid and come from this object.
+         *      Returns an iterator to the element that now occupies the same spot (the previous last element) which allows
+         *      erasing while iterating from begin() to end().
+         *
+         * @param it
+         * @return Iterator
+         */
+        Iterator erase(const Iterator& it)
+        {
+            size_t index = it.index;
+            uint64_t location = 0;
+            if(locate(hasher(getKey(data()[index])), getKey(data()[index]), location))
+                removeAt(location);
+            return Iterator(this, index);
+        }
+
+        /**
+         * @brief Gets the total number of elements added.
+         *
+         * @return size_t
+         */
+        size_t size() const
+        {
+            return totalElements;
+        }
+
+        /**
+         * @brief Gets the maximum number of elements that can be stored.
+         *
+         * @return size_t
+         */
+        static constexpr size_t capacity()
+        {
+            return Capacity;
+        }
+
+        /**
+         * @brief Get the Total number of buckets. Always the smallest power of 2 that keeps the load at or under 80%.
+         *
+         * @return size_t
+         */
+        static constexpr size_t getTotalBuckets()
+        {
+            return BUCKET_COUNT;
+        }
+
+        bool full() const
+        {
+            return totalElements == Capacity;
+        }
+
+        Iterator begin()
+        {
+            return Iterator(this, 0);
+        }
+        Iterator end()
+        {
+            return Iterator(this, totalElements);
+        }
+
+    private:
+        friend Iterator;
+
+        static constexpr size_t computeBucketCount()
+        {
+            size_t minimum = Capacity + (Capacity+3)/4; //at most 80% full
+            size_t count = 1;
+            while(count < minimum)
+                count <<= 1;
+            return count;
+        }
+
+        static constexpr size_t BUCKET_COUNT = computeBucketCount();
+        static constexpr size_t BUCKET_MASK = BUCKET_COUNT-1;
+        static const uint8_t VALID_BIT = 0x80;
+
+        KeyValueType* data()
+        {
+            return std::launder(reinterpret_cast<KeyValueType*>(storage));
+        }
+        const KeyValueType* data() const
+        {
+            return std::launder(reinterpret_cast<const KeyValueType*>(storage));
+        }
+
+        //finds the bucket holding the key. If it does not exist, location is set to the first empty bucket where it should go.
+        template<typename P>
+        bool locate(uint64_t actualHash, const P& key, uint64_t& location)
+        {
+            uint8_t partialHash = extractPartialHash(actualHash);
+            RedirectType extraHash = (RedirectType)actualHash;
+            location = actualHash & BUCKET_MASK;
+            while(fastHashInfo[location] != 0)
+            {
+                if(fastHashInfo[location] == partialHash && redirectInfo[location].first == extraHash)
+                {
+                    if(LIKELY( keyEqualFunc(getKey(data()[getRedirectInfo(location)]), key) ))
+                        return true;
+                }
+                location = (location+1) & BUCKET_MASK;
+            }
+            return false;
+        }
+
+        Iterator addToBucket(uint64_t location, uint64_t actualHash)
+        {
+            fastHashInfo[location] = extractPartialHash(actualHash);
+            redirectInfo[location] = {(RedirectType)actualHash, (RedirectType)totalElements};
+            totalElements++;
+            return Iterator(this, totalElements-1);
+        }
+
+        void removeAt(uint64_t bucketLocation)
+        {
+            RedirectType index = getRedirectInfo(bucketLocation);
+            RedirectType lastIndex = totalElements-1;
+            if(index != lastIndex)
+            {
+                //find the bucket pointing at the last element so it can be redirected to the removed spot
+                RedirectType lastSpotHash = (RedirectType)hasher(getKey(data()[lastIndex]));
+                uint64_t lastSpotLocation = lastSpotHash & BUCKET_MASK;
+                while(fastHashInfo[lastSpotLocation] == 0 || getRedirectInfo(lastSpotLocation) != lastIndex)
+                    lastSpotLocation = (lastSpotLocation+1) & BUCKET_MASK;
+
+                data()[index] = std::move(data()[lastIndex]);
+                redirectInfo[lastSpotLocation].second = index;
+            }
+            data()[lastIndex].~KeyValueType();
+            totalElements--;
+
+            //same backward shift as SimpleHashTable
+            fastHashInfo[bucketLocation] = 0;
+            uint64_t holeLocation = bucketLocation;
+            uint64_t location = (bucketLocation+1) & BUCKET_MASK;
+            while(fastHashInfo[location] != 0)
+            {
+                uint64_t distanceToHole = (location - holeLocation) & BUCKET_MASK;
+                uint64_t distanceFromDesired = (location - (redirectInfo[location].first & BUCKET_MASK)) & BUCKET_MASK;
+                if(distanceFromDesired >= distanceToHole)
+                {
+                    fastHashInfo[holeLocation] = fastHashInfo[location];
+                    redirectInfo[holeLocation] = redirectInfo[location];
+                    fastHashInfo[location] = 0;
+                    holeLocation = location;
+                }
+                location = (location+1) & BUCKET_MASK;
+            }
+        }
+
+        void copyFrom(const FixedSimpleHashTable& other)
+        {
+            for(size_t i=0; i<other.totalElements; i++)
+                new (&data()[i]) KeyValueType(other.data()[i]);
+            fastHashInfo = other.fastHashInfo;
+            redirectInfo = other.redirectInfo;
+            totalElements = other.totalElements;
+        }
+
+        void moveFrom(FixedSimpleHashTable&& other)
+        {
+            for(size_t i=0; i<other.totalElements; i++)
+                new (&data()[i]) KeyValueType(std::move(other.data()[i]));
+            fastHashInfo = other.fastHashInfo;
+            redirectInfo = other.redirectInfo;
+            totalElements = other.totalElements;
+            other.clear();
+        }
+
+        template<typename K, typename... Args, typename Q = Value>
+        typename std::enable_if<std::is_same_v<void, Q>, void>::type
+        constructInPlace(KeyValueType* location, K&& key)
+        {
+            new (location) KeyValueType(std::forward<K>(key));
+        }
+
+        template<typename K, typename... Args, typename Q = Value>
+        typename std::enable_if<!std::is_same_v<void, Q>, void>::type
+        constructInPlace(KeyValueType* location, K&& key, Args&&... args)
+        {
+            new (location) KeyValueType(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        }
+
+        template<class K = KeyValueType>
+        typename std::enable_if<std::is_same_v<Key, K>, const Key&>::type
+        getKey(const KeyValueType& v) const
+        {
+            return v;
+        }
+
+        template<class K = KeyValueType>
+        typename std::enable_if<!std::is_same_v<Key, K>, const Key&>::type
+        getKey(const KeyValueType& v) const
+        {
+            return v.first;
+        }
+
+        constexpr RedirectType getRedirectInfo(size_t loc) const
+        {
+            return redirectInfo[loc].second;
+        }
+
+        constexpr uint8_t extractPartialHash(uint64_t hash) const
+        {
+            uint64_t temp = rapid_mix(hash, std::uint64_t{0x9ddfea08eb382d69});
+            return temp | VALID_BIT;
+        }
+
+        std::array<uint8_t, BUCKET_COUNT> fastHashInfo = {}; //0x00 == empty
+        std::array<HashRedirectPair, BUCKET_COUNT> redirectInfo; //redirect info + stored hash
+        alignas(KeyValueType) unsigned char storage[Capacity * sizeof(KeyValueType)];
+        size_t totalElements = 0;
+
+        HashFunc hasher;
+        KeyEqual keyEqualFunc;
+    };
+}
@@ -0,0 +1,276 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <limits>
+
+namespace smpl
+{
+    /**
+     * @brief A hash map with a capacity that evicts the least recently used key when it is full.
+     *      The recency list is stored as two indices next to each element in the table's internal array (no list nodes) so
+     *      touching a key on lookup is a few index writes into elements that are already in cache.
+     *      Evicting uses the table's normal erase which moves the last element of the array into the evicted one's place.
+     *      Only the moved element's neighbours need their indices fixed. The evicted element's bucket is found by its hash and index
+     *      so no keys are compared.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class LruSimpleHashMap
+    {
+    public:
+        using RedirectType = std::conditional_t<BIG, uint64_t, uint32_t>;
+
+        //what the table stores for each key. newer and older are indices of the neighbours in the recency list
+        struct Entry
+        {
+            Value value;
+            RedirectType newer;
+            RedirectType older;
+        };
+
+        using TableType = SimpleHashMap<Key, Entry, HashFunc, KeyEqual, BIG>;
+
+        /**
+         * @brief Construct a new Lru Simple Hash Map.
+         *      Throws std::runtime_error if capacity is 0 or too large for the index type.
+         *
+         * @param capacity
+         *      The most keys kept at once.
+         */
+        LruSimpleHashMap(size_t capacity) : table(createTable(capacity))
+        {
+            this->capacity = capacity;
+            table.reserve(capacity);
+        }
+
+        /**
+         * @brief Finds the value of a key and marks it as the most recently used. Returns nullptr if it does not exist.
+         *      Counts a hit or a miss.
+         *      The pointer is valid until the next insert or erase.
+         *
+         * @param key
+         * @return Value*
+         */
+        Value* find(const Key& key)
+        {
+            auto it = table.find(key);
+            if(it == table.end())
+            {
+                misses++;
+                return nullptr;
+            }
+            hits++;
+            RedirectType index = (RedirectType)it.getIndex();
+            moveToFront(index);
+            return &table.arr[index].second.value;
+        }
+
+        /**
+         * @brief Same as find() but does not change the order or count a hit or a miss.
+         *
+         * @param key
+         * @return Value*
+         */
+        Value* peek(const Key& key)
+        {
+            auto it = table.find(key);
+            return (it == table.end()) ? nullptr : &it->second.value;
+        }
+
+        bool contains(const Key& key)
+        {
+            return table.find(key) != table.end();
+        }
+
+        /**
+         * @brief Inserts the key or replaces its value and marks it as the most recently used.
+         *      Evicts the least recently used key first if the map is full.
+         *      Returns true if the key was inserted and false if it was replaced.
+         *
+         * @param key
+         * @param value
+         * @return bool
+         */
+        bool insert_or_assign(const Key& key, Value value)
+        {
+            uint64_t hash = table.hashKey(key);
+            auto it = table.findHashed(hash, key);
+            if(it != table.end())
+            {
+                RedirectType index = (RedirectType)it.getIndex();
+                table.arr[index].second.value = std::move(value);
+                moveToFront(index);
+                return false;
+            }
+
+            if(table.size() >= capacity)
+                removeAt(table.getIteratorWithBucket(tail));
+            it = table.insertHashed(hash, {key, Entry{std::move(value), NO_INDEX, NO_INDEX}});
+            pushFront((RedirectType)it.getIndex());
+            return true;
+        }
+
+        /**
+         * @brief Removes the key if it exists. Returns if anything was removed.
+         *
+         * @param key
+         * @return bool
+         */
+        bool erase(const Key& key)
+        {
+            auto it = table.find(key);
+            if(it == table.end())
+                return false;
+            removeAt(it);
+            return true;
+        }
+
+        /**
+         * @brief Calls func(const Key&, Value&) for every key from the most to the least recently used. Does not change the order.
+         *
+         * @tparam F
+         * @param func
+         */
+        template<typename F>
+        void forEachMostRecent(F&& func)
+        {
+            for(RedirectType index = head; index != NO_INDEX; index = table.arr[index].second.older)
+                func(table.arr[index].first, table.arr[index].second.value);
+        }
+
+        void clear()
+        {
+            table.clear();
+            head = NO_INDEX;
+            tail = NO_INDEX;
+        }
+
+        uint64_t size()
+        {
+            return table.size();
+        }
+
+        size_t getCapacity()
+        {
+            return capacity;
+        }
+
+        uint64_t getHits()
+        {
+            return hits;
+        }
+
+        uint64_t getMisses()
+        {
+            return misses;
+        }
+
+        /**
+         * @brief Gets the fraction of find() calls that found their key. 0 if find() was never called.
+         *
+         * @return double
+         */
+        double getHitRate()
+        {
+            uint64_t total = hits + misses;
+            return (total == 0) ? 0.0 : (double)hits / (double)total;
+        }
+
+        void resetStats()
+        {
+            hits = 0;
+            misses = 0;
+        }
+
+    private:
+        static constexpr RedirectType NO_INDEX = std::numeric_limits<RedirectType>::max();
+        static constexpr double MAX_LOAD = 0.4;
+
+        //validates capacity before anything is allocated
+        static TableType createTable(size_t capacity)
+        {
+            if(capacity == 0 || capacity >= NO_INDEX)
+                throw std::runtime_error("INVALID CAPACITY");
+            if(capacity <= TableType::SMALL_TABLE_SIZE)
+                return TableType();
+
+            //the map stays full so every insert is also an erase. Erasing shifts back the rest of the bucket's run and runs are
+            //  much longer at the table's usual max load so the buckets are sized for a lower one.
+            size_t bucketCount = 1024;
+            while(capacity >= bucketCount*MAX_LOAD)
+                bucketCount *= 2;
+            return TableType(bucketCount);
+        }
+
+        Entry& entryAt(RedirectType index)
+        {
+            return table.arr[index].second;
+        }
+
+        void unlink(RedirectType index)
+        {
+            Entry& e = entryAt(index);
+            if(e.newer != NO_INDEX)
+                entryAt(e.newer).older = e.older;
+            else
+                head = e.older;
+            if(e.older != NO_INDEX)
+                entryAt(e.older).newer = e.newer;
+            else
+                tail = e.newer;
+        }
+
+        void pushFront(RedirectType index)
+        {
+            Entry& e = entryAt(index);
+            e.newer = NO_INDEX;
+            e.older = head;
+            if(head != NO_INDEX)
+                entryAt(head).newer = index;
+            head = index;
+            if(tail == NO_INDEX)
+                tail = index;
+        }
+
+        void moveToFront(RedirectType index)
+        {
+            if(index == head)
+                return;
+            unlink(index);
+            pushFront(index);
+        }
+
+        //it must have its bucket index set (from find() or getIteratorWithBucket()) so erase() does not search for the key again.
+        //Erasing moves the last element of the array into index so the links pointing at it are fixed afterwards.
+        void removeAt(const typename TableType::Iterator& it)
+        {
+            RedirectType index = (RedirectType)it.getIndex();
+            unlink(index);
+            RedirectType last = (RedirectType)(table.arr.size() - 1);
+            table.erase(it);
+            if(index == last)
+                return;
+
+            Entry& moved = entryAt(index);
+            if(moved.newer != NO_INDEX)
+                entryAt(moved.newer).older = index;
+            else
+                head = index;
+            if(moved.older != NO_INDEX)
+                entryAt(moved.older).newer = index;
+            else
+                tail = index;
+        }
+
+        TableType table;
+        size_t capacity = 0;
+        RedirectType head = NO_INDEX; //most recently used
+        RedirectType tail = NO_INDEX; //least recently used
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+}
@@ -0,0 +1,311 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include "SimpleHashMappedFile.h"
+#include <string>
+
+namespace smpl
+{
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class MappedSimpleHashTable;
+
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    using MappedSimpleHashMap = MappedSimpleHashTable<Key, Value, HashFunc, KeyEqual, BIG>;
+
+    template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    using MappedSimpleHashSet = MappedSimpleHashTable<Key, void, HashFunc, KeyEqual, BIG>;
+
+    /**
+     * @brief A read only hash table that uses a snapshot file written by SimpleHashTable::save() in place.
+     *      The file is memory mapped so opening it is O(1) regardless of its size. Pages are only read when a search touches them,
+     *      the operating system can drop them under memory pressure, and every process that maps the same file shares them.
+     *
+     *      Only snapshots of non multi tables whose elements are trivially copyable (or std::pair of those) can be mapped
+     *      since the elements must be usable directly from the file.
+     *      The snapshot must have been written by a SimpleHashTable with the same Key, Value, HashFunc and BIG.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename Value, typename HashFunc, typename KeyEqual, bool BIG>
+    class MappedSimpleHashTable
+    {
+    public:
+        using TableType = SimpleHashTable<Key, Value, false, HashFunc, KeyEqual, BIG>;
+        using RedirectType = typename TableType::RedirectType;
+        using HashRedirectPair = typename TableType::HashRedirectPair;
+        using KeyValueType = typename TableType::KeyValueType;
+
+        static_assert(is_raw_serializable_v<KeyValueType>, "Only trivially copyable elements can be used directly from a mapped file");
+        static_assert(alignof(KeyValueType) <= SNAPSHOT_ALIGNMENT, "Elements must not need more alignment than a snapshot section");
+
+        MappedSimpleHashTable(){}
+
+        /**
+         * @brief Maps a snapshot file. Throws std::runtime_error if it can not be mapped or is not a valid snapshot for this table.
+         *      See open()
+         *
+         * @param filename
+         * @param verifyChecksum
+         */
+        MappedSimpleHashTable(const std::string& filename, bool verifyChecksum = false)
+        {
+            open(filename, verifyChecksum);
+        }
+
+        MappedSimpleHashTable(const MappedSimpleHashTable& other) = delete;
+        MappedSimpleHashTable& operator=(const MappedSimpleHashTable& other) = delete;
+
+        MappedSimpleHashTable(MappedSimpleHashTable&& other) noexcept
+        {
+            moveFrom(other);
+        }
+
+        MappedSimpleHashTable& operator=(MappedSimpleHashTable&& other) noexcept
+        {
+            if(this != &other)
+            {
+                close();
+                moveFrom(other);
+            }
+            return *this;
+        }
+
+        ~MappedSimpleHashTable()
+        {
+            close();
+        }
+
+        /**
+         * @brief Maps a snapshot file replacing anything mapped before.
+         *      Only the header and the section sizes are checked by default so opening does not touch the rest of the file.
+         *      Set verifyChecksum to read the whole file once and check its checksum. Do this for files that may be corrupted
+         *      since a corrupted file that passes the basic checks can cause reads outside of the file.
+         *
+         *      Throws std::runtime_error if the file can not be mapped or is not a valid snapshot for this table.
+         *
+         * @param filename
+         * @param verifyChecksum
+         */
+        void open(const std::string& filename, bool verifyChecksum = false)
+        {
+            close();
+            file.open(filename);
+            try
+            {
+                setupView(verifyChecksum);
+            }
+            catch(...)
+            {
+                close();
+                throw;
+            }
+        }
+
+        /**
+         * @brief Unmaps the file. The table is empty afterwards.
+         *      Anything returned by find() or begin() is no longer valid.
+         *
+         */
+        void close()
+        {
+            file.close();
+            fastHashInfo = nullptr;
+            redirectInfo = nullptr;
+            denseIndex = nullptr;
+            elements = nullptr;
+            bucketCount = 0;
+            elementCount = 0;
+            denseCount = 0;
+            denseMin = 0;
+        }
+
+        /**
+         * @brief Returns whether a file is currently mapped.
+         *
+         * @return bool
+         */
+        bool isOpen() const
+        {
+            return file.data() != nullptr;
+        }
+
+        /**
+         * @brief Attempts to find an element by P.
+         *      Enabled if HashFunc and KeyEqual are both transparent.
+         *      Returns a pointer to the element in the mapped file or end() if it does not exist.
+         *
+         * @tparam P
+         * @param p
+         * @return const KeyValueType*
+         */
+        template<typename P, typename H = HashFunc, typename KE = KeyEqual,
+        std::enable_if_t<both_transparent_v<H, KE>, bool> = true>
+        const KeyValueType* find(const P& p) const
+        {
+            return search(p);
+        }
+
+        /**
+         * @brief Attempts to find an element by its Key.
+         *      Returns a pointer to the element in the mapped file or end() if it does not exist.
+         *
+         * @param k
+         * @return const KeyValueType*
+         */
+        const KeyValueType* find(const Key& k) const
+        {
+            return search(k);
+        }
+
+        /**
+         * @brief Returns if an element with the Key exists.
+         *
+         * @param k
+         * @return bool
+         */
+        bool contains(const Key& k) const
+        {
+            return search(k) != end();
+        }
+
+        const KeyValueType* begin() const
+        {
+            return elements;
+        }
+
+        const KeyValueType* end() const
+        {
+            return elements + elementCount;
+        }
+
+        /**
+         * @brief Gets the total number of elements in the mapped snapshot.
+         *
+         * @return uint64_t
+         */
+        uint64_t size() const
+        {
+            return elementCount;
+        }
+
+        /**
+         * @brief Get the Total number of buckets in the mapped snapshot.
+         *      0 if the table was small or dense when it was saved.
+         *
+         * @return uint64_t
+         */
+        uint64_t getTotalBuckets() const
+        {
+            return bucketCount;
+        }
+
+    private:
+        void moveFrom(MappedSimpleHashTable& other)
+        {
+            file = std::move(other.file);
+            fastHashInfo = other.fastHashInfo;
+            redirectInfo = other.redirectInfo;
+            denseIndex = other.denseIndex;
+            elements = other.elements;
+            bucketCount = other.bucketCount;
+            elementCount = other.elementCount;
+            denseCount = other.denseCount;
+            denseMin = other.denseMin;
+            std::memcpy(smallHashInfo, other.smallHashInfo, sizeof(smallHashInfo));
+            hasher = other.hasher;
+            keyEqualFunc = other.keyEqualFunc;
+
+            other.close();
+        }
+
+        //finds every section using the same layout as SimpleHashTable::save()
+        void setupView(bool verifyChecksum)
+        {
+            const uint8_t* base = file.data();
+            size_t mappedSize = file.size();
+            if(mappedSize < sizeof(SimpleHashSnapshotHeader) + sizeof(uint64_t))
+                throw std::runtime_error("SNAPSHOT TRUNCATED");
+
+            SimpleHashSnapshotHeader header;
+            std::memcpy(&header, base, sizeof(header));
+            uint64_t expected = header.headerChecksum;
+            header.headerChecksum = 0;
+            if(std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || rapidhash(&header, sizeof(header)) != expected)
+                throw std::runtime_error("INVALID SNAPSHOT HEADER");
+            if(header.version != SNAPSHOT_VERSION)
+                throw std::runtime_error("UNSUPPORTED SNAPSHOT VERSION");
+            if(header.flags != TableType::getSnapshotFlags() || header.keySize != sizeof(Key) || header.valueSize != TableType::getValueSize()
+                || header.elementSize != sizeof(KeyValueType) || header.redirectSize != sizeof(RedirectType))
+                throw std::runtime_error("SNAPSHOT DOES NOT MATCH TABLE TYPE");
+            if((header.bucketCount != 0 || !TableType::DENSE_ALLOWED) && header.denseCount != 0)
+                throw std::runtime_error("INVALID SNAPSHOT HEADER");
+            if(header.bucketCount == 0 && header.denseCount == 0 && header.elementCount > TableType::SMALL_TABLE_SIZE)
+                throw std::runtime_error("INVALID SNAPSHOT HEADER");
+
+            uint64_t offset = sizeof(SimpleHashSnapshotHeader);
+            uint64_t hashInfoOffset = offset;
+            offset = alignOffset(offset + header.bucketCount);
+            uint64_t redirectOffset = offset;
+            offset = alignOffset(offset + header.bucketCount*sizeof(HashRedirectPair));
+            uint64_t denseOffset = offset;
+            offset = alignOffset(offset + header.denseCount*sizeof(RedirectType));
+            uint64_t elementOffset = offset;
+            offset = alignOffset(offset + header.elementCount*sizeof(KeyValueType));
+            if(offset + sizeof(uint64_t) != mappedSize)
+                throw std::runtime_error("SNAPSHOT TRUNCATED");
+
+            if(verifyChecksum)
+            {
+                SimpleHashChecksum checksum;
+                checksum.update(base + sizeof(SimpleHashSnapshotHeader), offset - sizeof(SimpleHashSnapshotHeader));
+                uint64_t storedChecksum;
+                std::memcpy(&storedChecksum, base + offset, sizeof(storedChecksum));
+                if(checksum.finish() != storedChecksum)
+                    throw std::runtime_error("SNAPSHOT CHECKSUM MISMATCH");
+            }
+
+            fastHashInfo = base + hashInfoOffset;
+            redirectInfo = (const HashRedirectPair*)(base + redirectOffset);
+            denseIndex = (const RedirectType*)(base + denseOffset);
+            elements = (const KeyValueType*)(base + elementOffset);
+            bucketCount = header.bucketCount;
+            elementCount = header.elementCount;
+            denseCount = header.denseCount;
+            denseMin = header.denseMin;
+            std::memcpy(smallHashInfo, header.smallHashInfo, sizeof(smallHashInfo));
+        }
+
+        static uint64_t alignOffset(uint64_t offset)
+        {
+            return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+        }
+
+        //SimpleHashTable's own search running over the mapped sections
+        template<typename P>
+        const KeyValueType* search(const P& k) const
+        {
+            typename TableType::SearchView view = {fastHashInfo, redirectInfo, bucketCount, denseIndex, denseCount, denseMin,
+                smallHashInfo, elements, nullptr, elementCount};
+            size_t bucketIndex = -1;
+            return elements + TableType::template searchIn<false>(view, hasher, keyEqualFunc, 0, k, bucketIndex);
+        }
+
+        SimpleHashMappedFile file;
+
+        const uint8_t* fastHashInfo = nullptr;
+        const HashRedirectPair* redirectInfo = nullptr;
+        const RedirectType* denseIndex = nullptr;
+        const KeyValueType* elements = nullptr;
+        uint64_t bucketCount = 0;
+        uint64_t elementCount = 0;
+        uint64_t denseCount = 0;
+        uint64_t denseMin = 0;
+        uint8_t smallHashInfo[16] = {};
+
+        HashFunc hasher;
+        KeyEqual keyEqualFunc;
+    };
+}
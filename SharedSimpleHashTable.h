@@ -0,0 +1,529 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <new>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace smpl
+{
+    /**
+     * @brief A fixed capacity hash map that lives in named shared memory so every process on a machine can use one copy.
+     *      One process creates the map with create() and is the only one allowed to change it.
+     *      Any number of processes open() it read only. Readers never lock. A sequence counter (seqlock) is bumped by the writer
+     *      before and after every change and a reader retries its search if the counter changed while it was searching.
+     *
+     *      Everything in the segment is addressed by offset so it can be mapped at a different address in every process.
+     *      Keys and values must be trivially copyable since they are stored in the segment directly. Values are copied out by find().
+     *      The same HashFunc must be used by every process.
+     *
+     *      Uses shm_open + mmap on POSIX systems and named file mappings on Windows.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class SharedSimpleHashMap
+    {
+    public:
+        using TableType = SimpleHashMap<Key, Value, HashFunc, KeyEqual, BIG>;
+        using RedirectType = typename TableType::RedirectType;
+        using HashRedirectPair = typename TableType::HashRedirectPair;
+
+        static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>, "Keys and values in shared memory must be trivially copyable");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "The sequence counter must be lock free to be shared between processes");
+
+        SharedSimpleHashMap(){}
+
+        SharedSimpleHashMap(const SharedSimpleHashMap& other) = delete;
+        SharedSimpleHashMap& operator=(const SharedSimpleHashMap& other) = delete;
+
+        SharedSimpleHashMap(SharedSimpleHashMap&& other) noexcept
+        {
+            moveFrom(other);
+        }
+
+        SharedSimpleHashMap& operator=(SharedSimpleHashMap&& other) noexcept
+        {
+            if(this != &other)
+            {
+                close();
+                moveFrom(other);
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Unmaps the segment. The segment itself stays until remove() is called.
+         *
+         */
+        ~SharedSimpleHashMap()
+        {
+            close();
+        }
+
+        /**
+         * @brief Creates the named segment with room for capacity elements and maps it for writing.
+         *      On POSIX systems the name should start with a '/'.
+         *      Throws std::runtime_error if the segment can not be created or the name already exists. An existing segment is never
+         *      reused since readers that have it mapped could see it resized or half initialized. Call remove() first to replace one.
+         *
+         * @param name
+         * @param capacity
+         * @return SharedSimpleHashMap
+         */
+        static SharedSimpleHashMap create(const std::string& name, uint64_t capacity)
+        {
+            uint64_t bucketCount = 1024;
+            while(capacity >= bucketCount*MAX_LOAD)
+                bucketCount *= 2;
+            if(!BIG && capacity >= UINT32_MAX)
+                throw std::runtime_error("TOO LARGE");
+
+            SharedSimpleHashMap result;
+            result.mapSegment(name, getSegmentSize(bucketCount, capacity), true);
+            result.writable = true;
+
+            SharedHeader* header = new(result.segment) SharedHeader();
+            header->magic = SHARED_MAGIC;
+            header->keySize = sizeof(Key);
+            header->valueSize = sizeof(Value);
+            header->redirectSize = sizeof(RedirectType);
+            header->bucketCount = bucketCount;
+            header->capacity = capacity;
+            result.setupView(); //a new segment is zeroed so every bucket starts empty
+            return result;
+        }
+
+        /**
+         * @brief Maps an existing segment created by create() for reading.
+         *      Throws std::runtime_error if the segment does not exist or was created by a different type of map.
+         *
+         * @param name
+         * @return SharedSimpleHashMap
+         */
+        static SharedSimpleHashMap open(const std::string& name)
+        {
+            SharedSimpleHashMap result;
+            result.mapSegment(name, 0, false);
+            const SharedHeader* header = (const SharedHeader*)result.segment;
+            if(result.segmentSize < sizeof(SharedHeader) || header->magic != SHARED_MAGIC || header->keySize != sizeof(Key)
+                || header->valueSize != sizeof(Value) || header->redirectSize != sizeof(RedirectType)
+                || result.segmentSize < getSegmentSize(header->bucketCount, header->capacity))
+                throw std::runtime_error("SHARED MAP DOES NOT MATCH TABLE TYPE");
+            result.setupView();
+            return result;
+        }
+
+        /**
+         * @brief Removes the named segment. Processes that have it mapped can keep using it until they close it.
+         *
+         * @param name
+         */
+        static void remove(const std::string& name)
+        {
+#ifndef _WIN32
+            shm_unlink(name.c_str());
+#endif
+            //Windows removes a named mapping once every handle to it is closed
+        }
+
+        /**
+         * @brief Unmaps the segment.
+         *
+         */
+        void close()
+        {
+            if(segment != nullptr)
+            {
+#ifdef _WIN32
+                UnmapViewOfFile(segment);
+                CloseHandle(mappingHandle);
+                mappingHandle = nullptr;
+#else
+                munmap(segment, segmentSize);
+#endif
+            }
+            segment = nullptr;
+            segmentSize = 0;
+            header = nullptr;
+            writable = false;
+        }
+
+        /**
+         * @brief Inserts the key or replaces its value. Only allowed in the process that created the map.
+         *      Returns false if the key is new and the map is already at its capacity.
+         *
+         * @param key
+         * @param value
+         * @return bool
+         */
+        bool insert_or_assign(const Key& key, const Value& value)
+        {
+            checkWritable();
+            uint64_t actualHash = hasher(key);
+            uint64_t location = findLocation(key, actualHash);
+            if(fastHashInfo[location] != 0)
+            {
+                beginWrite();
+                elements[redirectInfo[location].second].value = value;
+                endWrite();
+                return true;
+            }
+
+            uint64_t count = header->elementCount.load(std::memory_order_relaxed);
+            if(count == header->capacity)
+                return false;
+
+            beginWrite();
+            elements[count].key = key;
+            elements[count].value = value;
+            redirectInfo[location] = {(RedirectType)actualHash, (RedirectType)count};
+            fastHashInfo[location] = TableType::extractPartialHash(actualHash);
+            header->elementCount.store(count+1, std::memory_order_relaxed);
+            endWrite();
+            return true;
+        }
+
+        /**
+         * @brief Removes the key if it exists. Only allowed in the process that created the map.
+         *      Returns if anything was removed.
+         *
+         * @param key
+         * @return bool
+         */
+        bool erase(const Key& key)
+        {
+            checkWritable();
+            uint64_t hole = findLocation(key, hasher(key));
+            if(fastHashInfo[hole] == 0)
+                return false;
+
+            beginWrite();
+            uint64_t removedIndex = redirectInfo[hole].second;
+            fastHashInfo[hole] = 0;
+
+            //backward shift so no tombstones are needed
+            uint64_t next = (hole+1) % bucketCount;
+            while(fastHashInfo[next] != 0)
+            {
+                uint64_t desired = redirectInfo[next].first % bucketCount;
+                uint64_t distanceFromDesired = (next + bucketCount - desired) % bucketCount;
+                uint64_t distanceToHole = (next + bucketCount - hole) % bucketCount;
+                if(distanceFromDesired >= distanceToHole)
+                {
+                    fastHashInfo[hole] = fastHashInfo[next];
+                    redirectInfo[hole] = redirectInfo[next];
+                    fastHashInfo[next] = 0;
+                    hole = next;
+                }
+                next = (next+1) % bucketCount;
+            }
+
+            //keep the elements packed by moving the last one into the removed spot
+            uint64_t lastIndex = header->elementCount.load(std::memory_order_relaxed) - 1;
+            if(removedIndex != lastIndex)
+            {
+                uint64_t lastLocation = findLocation(elements[lastIndex].key, hasher(elements[lastIndex].key));
+                elements[removedIndex] = elements[lastIndex];
+                redirectInfo[lastLocation].second = (RedirectType)removedIndex;
+            }
+            header->elementCount.store(lastIndex, std::memory_order_relaxed);
+            endWrite();
+            return true;
+        }
+
+        /**
+         * @brief Attempts to find the key and copies its value into output. Returns if it was found.
+         *      Safe to call from any process while the writer is changing the map. Retries if the writer changed something during the search.
+         *
+         * @param key
+         * @param output
+         * @return bool
+         */
+        bool find(const Key& key, Value& output) const
+        {
+            uint64_t actualHash = hasher(key);
+            while(true)
+            {
+                uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+                if(sequence & 1)
+                {
+                    std::this_thread::yield(); //writer is in the middle of a change
+                    continue;
+                }
+
+                bool found = searchUnsynchronized(key, actualHash, &output);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(header->sequence.load(std::memory_order_relaxed) == sequence)
+                    return found;
+            }
+        }
+
+        bool contains(const Key& key) const
+        {
+            uint64_t actualHash = hasher(key);
+            while(true)
+            {
+                uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+                if(sequence & 1)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                bool found = searchUnsynchronized(key, actualHash, nullptr);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(header->sequence.load(std::memory_order_relaxed) == sequence)
+                    return found;
+            }
+        }
+
+        uint64_t size() const
+        {
+            return header->elementCount.load(std::memory_order_acquire);
+        }
+
+        uint64_t capacity() const
+        {
+            return header->capacity;
+        }
+
+        uint64_t getTotalBuckets() const
+        {
+            return bucketCount;
+        }
+
+        bool isWritable() const
+        {
+            return writable;
+        }
+
+    private:
+        static constexpr uint64_t SHARED_MAGIC = 0x3150414853504D53; //"SMPSHAP1"
+        static constexpr double MAX_LOAD = 0.8;
+
+        struct alignas(64) SharedHeader
+        {
+            uint64_t magic;
+            uint32_t keySize;
+            uint32_t valueSize;
+            uint32_t redirectSize;
+            uint64_t bucketCount;
+            uint64_t capacity;
+            std::atomic<uint64_t> elementCount = 0;
+            std::atomic<uint64_t> sequence = 0; //odd while the writer is changing something
+        };
+
+        struct Entry
+        {
+            Key key;
+            Value value;
+        };
+
+        //Segment layout. Every section starts at a multiple of 64 bytes
+        //  SharedHeader | fastHashInfo (bucketCount bytes) | redirectInfo (bucketCount pairs) | elements (capacity entries)
+        static uint64_t alignOffset(uint64_t offset)
+        {
+            return (offset + 63) / 64 * 64;
+        }
+
+        static uint64_t getRedirectOffset(uint64_t bucketCount)
+        {
+            return alignOffset(sizeof(SharedHeader) + bucketCount);
+        }
+
+        static uint64_t getElementOffset(uint64_t bucketCount)
+        {
+            return alignOffset(getRedirectOffset(bucketCount) + bucketCount*sizeof(HashRedirectPair));
+        }
+
+        static uint64_t getSegmentSize(uint64_t bucketCount, uint64_t capacity)
+        {
+            return getElementOffset(bucketCount) + capacity*sizeof(Entry);
+        }
+
+        void setupView()
+        {
+            uint8_t* base = (uint8_t*)segment;
+            header = (SharedHeader*)base;
+            bucketCount = header->bucketCount;
+            fastHashInfo = base + sizeof(SharedHeader);
+            redirectInfo = (HashRedirectPair*)(base + getRedirectOffset(bucketCount));
+            elements = (Entry*)(base + getElementOffset(bucketCount));
+        }
+
+        void mapSegment(const std::string& name, uint64_t size, bool create)
+        {
+#ifdef _WIN32
+            HANDLE mapping;
+            if(create)
+                mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, name.c_str());
+            else
+                mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+            if(mapping == nullptr)
+                throw std::runtime_error("COULD NOT OPEN SHARED MEMORY");
+            if(create && GetLastError() == ERROR_ALREADY_EXISTS)
+            {
+                CloseHandle(mapping);
+                throw std::runtime_error("SHARED MEMORY ALREADY EXISTS");
+            }
+            void* data = MapViewOfFile(mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0);
+            if(data == nullptr)
+            {
+                CloseHandle(mapping);
+                throw std::runtime_error("COULD NOT MAP SHARED MEMORY");
+            }
+            MEMORY_BASIC_INFORMATION info;
+            VirtualQuery(data, &info, sizeof(info));
+            mappingHandle = mapping; //the name only exists while a handle is open
+            segment = data;
+            segmentSize = create ? size : info.RegionSize;
+#else
+            int fd = create ? shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644) : shm_open(name.c_str(), O_RDONLY, 0);
+            if(fd < 0)
+                throw std::runtime_error((create && errno == EEXIST) ? "SHARED MEMORY ALREADY EXISTS" : "COULD NOT OPEN SHARED MEMORY");
+            if(create && ftruncate(fd, (off_t)size) != 0)
+            {
+                ::close(fd);
+                shm_unlink(name.c_str()); //this call created it so nobody else can have it mapped
+                throw std::runtime_error("COULD NOT OPEN SHARED MEMORY");
+            }
+            if(!create)
+            {
+                struct stat info;
+                if(fstat(fd, &info) != 0)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("COULD NOT OPEN SHARED MEMORY");
+                }
+                size = (uint64_t)info.st_size;
+            }
+            void* data = (size == 0) ? MAP_FAILED : mmap(nullptr, size, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if(data == MAP_FAILED)
+            {
+                if(create)
+                    shm_unlink(name.c_str());
+                throw std::runtime_error("COULD NOT MAP SHARED MEMORY");
+            }
+            segment = data;
+            segmentSize = size;
+#endif
+        }
+
+        void moveFrom(SharedSimpleHashMap& other)
+        {
+            segment = other.segment;
+            segmentSize = other.segmentSize;
+#ifdef _WIN32
+            mappingHandle = other.mappingHandle;
+            other.mappingHandle = nullptr;
+#endif
+            writable = other.writable;
+            if(segment != nullptr)
+                setupView();
+            hasher = other.hasher;
+            keyEqualFunc = other.keyEqualFunc;
+            other.segment = nullptr;
+            other.close();
+        }
+
+        void checkWritable()
+        {
+            if(!writable)
+                throw std::runtime_error("SHARED MAP IS READ ONLY");
+        }
+
+        void beginWrite()
+        {
+            header->sequence.store(header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void endWrite()
+        {
+            header->sequence.store(header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        //Writer only. Returns the bucket holding the key or the empty bucket where it would go.
+        uint64_t findLocation(const Key& key, uint64_t actualHash)
+        {
+            uint8_t partialHash = TableType::extractPartialHash(actualHash);
+            RedirectType extraHash = (RedirectType)actualHash;
+            uint64_t location = actualHash % bucketCount;
+            while(fastHashInfo[location] != 0)
+            {
+                if(fastHashInfo[location] == partialHash && redirectInfo[location].first == extraHash
+                    && keyEqualFunc(elements[redirectInfo[location].second].key, key))
+                    return location;
+                location = (location+1) % bucketCount;
+            }
+            return location;
+        }
+
+        //May see a half finished change. Never reads outside of the segment and never loops forever so the caller can just retry.
+        bool searchUnsynchronized(const Key& key, uint64_t actualHash, Value* output) const
+        {
+            uint8_t partialHash = TableType::extractPartialHash(actualHash);
+            RedirectType extraHash = (RedirectType)actualHash;
+            uint64_t location = actualHash % bucketCount;
+            uint64_t capacity = header->capacity;
+            for(uint64_t probes=0; probes<bucketCount && fastHashInfo[location] != 0; probes++)
+            {
+                HashRedirectPair redirect = redirectInfo[location];
+                if(fastHashInfo[location] == partialHash && redirect.first == extraHash && redirect.second < capacity)
+                {
+                    //copied out first so the key and value always come from the same moment
+                    struct Bytes { unsigned char data[sizeof(Entry)]; } bytes;
+                    std::memcpy(bytes.data, (const void*)&elements[redirect.second], sizeof(Entry));
+                    Entry entry = std::bit_cast<Entry>(bytes);
+                    if(keyEqualFunc(entry.key, key))
+                    {
+                        if(output != nullptr)
+                            *output = entry.value;
+                        return true;
+                    }
+                }
+                location = (location+1) % bucketCount;
+            }
+            return false;
+        }
+
+        void* segment = nullptr;
+        uint64_t segmentSize = 0;
+#ifdef _WIN32
+        HANDLE mappingHandle = nullptr;
+#endif
+        bool writable = false;
+
+        SharedHeader* header = nullptr;
+        uint64_t bucketCount = 0;
+        uint8_t* fastHashInfo = nullptr;
+        HashRedirectPair* redirectInfo = nullptr;
+        Entry* elements = nullptr;
+
+        HashFunc hasher;
+        KeyEqual keyEqualFunc;
+    };
+}
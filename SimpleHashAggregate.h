@@ -0,0 +1,247 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <atomic>
+#include <thread>
+
+namespace smpl
+{
+    //Combine functions for SimpleHashAggregator. Called as combine(Value& existing, Value&& incoming).
+    template<typename Value>
+    struct SimpleHashSum
+    {
+        void operator()(Value& existing, Value&& incoming) const
+        {
+            existing += incoming;
+        }
+    };
+
+    //Count by adding a value of 1 for every row.
+    using SimpleHashCount = SimpleHashSum<uint64_t>;
+
+    template<typename Value>
+    struct SimpleHashMin
+    {
+        void operator()(Value& existing, Value&& incoming) const
+        {
+            if(incoming < existing)
+                existing = std::move(incoming);
+        }
+    };
+
+    template<typename Value>
+    struct SimpleHashMax
+    {
+        void operator()(Value& existing, Value&& incoming) const
+        {
+            if(existing < incoming)
+                existing = std::move(incoming);
+        }
+    };
+
+    struct SimpleHashAggregateOptions
+    {
+        //Threads adding rows (aggregate() starts this many) and merging partitions. 0 uses one per hardware thread.
+        size_t threads = 0;
+
+        //Number of partitions partial results are merged in. 0 uses 4 per thread.
+        size_t partitions = 0;
+
+        //Every bypassCheckRows rows a thread checks if its table is reducing the rows enough to be worth it.
+        //  If the table has more than bypassMinGroups groups and more than bypassRatio groups per row, the thread stops
+        //  aggregating locally and passes rows straight to the merge (pre-aggregation bypass). 0 never checks.
+        uint64_t bypassCheckRows = 1<<16;
+        uint64_t bypassMinGroups = 1<<16;
+        double bypassRatio = 0.5;
+    };
+
+    /**
+     * @brief Group by with per thread partial tables.
+     *      Every thread adds rows to its own SimpleHashMap without locking, combining rows with the same key (pre-aggregation).
+     *      finish() splits each partial table by hash range (SimpleHashTable::split()) and merges the matching ranges of every
+     *      thread in parallel with SimpleHashTable::mergeWith(). Neither step hashes a key again.
+     *
+     *      When the groups are nearly as many as the rows, pre-aggregating only adds a table insert per row so a thread that sees
+     *      this switches to buffering rows by hash range for the merge instead (see SimpleHashAggregateOptions).
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam CombineFunc
+     *      Called as combine(Value& existing, Value&& incoming) for rows with the same key. See SimpleHashSum, SimpleHashCount,
+     *      SimpleHashMin and SimpleHashMax.
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     */
+    template<typename Key, typename Value, typename CombineFunc = SimpleHashSum<Value>, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    class SimpleHashAggregator
+    {
+    public:
+        using TableType = SimpleHashMap<Key, Value, HashFunc, KeyEqual>;
+        using KeyValueType = std::pair<Key, Value>;
+
+        SimpleHashAggregator(SimpleHashAggregateOptions options = SimpleHashAggregateOptions(), CombineFunc combine = CombineFunc())
+        {
+            this->options = options;
+            this->combine = combine;
+            threadCount = options.threads != 0 ? options.threads : __max(std::thread::hardware_concurrency(), 1);
+            partitionCount = options.partitions != 0 ? options.partitions : threadCount*4;
+            locals = std::vector<Local>(threadCount);
+        }
+
+        /**
+         * @brief Groups rows with keyFunc(row) and combines valueFunc(row) for each group using several threads.
+         *
+         * @tparam Row
+         * @tparam KeyFunc
+         * @tparam ValueFunc
+         * @param rows
+         * @param keyFunc
+         * @param valueFunc
+         * @param combine
+         * @param options
+         * @return TableType
+         */
+        template<typename Row, typename KeyFunc, typename ValueFunc>
+        static TableType aggregate(const std::vector<Row>& rows, KeyFunc keyFunc, ValueFunc valueFunc, CombineFunc combine = CombineFunc(), SimpleHashAggregateOptions options = SimpleHashAggregateOptions())
+        {
+            SimpleHashAggregator aggregator(options, combine);
+            size_t perThread = (rows.size() + aggregator.threadCount - 1) / aggregator.threadCount;
+            runSimpleHashThreads(aggregator.threadCount, [&](size_t thread)
+            {
+                size_t end = __min((thread+1)*perThread, rows.size());
+                for(size_t i=thread*perThread; i<end; i++)
+                    aggregator.add(thread, keyFunc(rows[i]), valueFunc(rows[i]));
+            });
+            return aggregator.finish();
+        }
+
+        /**
+         * @brief Adds a row. Only one thread may use each thread index at a time but different indices need no locking.
+         *
+         * @param thread
+         *      Less than the number of threads in the options.
+         * @param key
+         * @param value
+         */
+        void add(size_t thread, const Key& key, Value value)
+        {
+            Local& local = locals[thread];
+            uint64_t hash = local.table.hashKey(key);
+            if(local.bypassing)
+            {
+                local.bypassed[TableType::getHashRangeIndex(hash, partitionCount)].emplace_back(hash, KeyValueType(key, std::move(value)));
+                return;
+            }
+
+            combineInto(local.table, hash, KeyValueType(key, std::move(value)));
+            local.rows++;
+            if(options.bypassCheckRows != 0 && local.rows % options.bypassCheckRows == 0
+                && local.table.size() > options.bypassMinGroups && local.table.size() > local.rows*options.bypassRatio)
+            {
+                local.bypassing = true;
+                local.bypassed.resize(partitionCount);
+            }
+        }
+
+        /**
+         * @brief Merges every thread's rows and returns the result split into hash ranges (see SimpleHashTable::getHashRangeIndex()).
+         *      The aggregator is empty afterwards and can be used again.
+         *
+         * @return std::vector<TableType>
+         */
+        std::vector<TableType> finishPartitioned()
+        {
+            std::vector<std::vector<TableType>> parts(threadCount);
+            runSimpleHashThreads(threadCount, [&](size_t thread)
+            {
+                parts[thread] = locals[thread].table.split(partitionCount);
+            });
+
+            std::vector<TableType> result(partitionCount);
+            std::atomic<size_t> nextPartition = 0;
+            runSimpleHashThreads(threadCount, [&](size_t thread)
+            {
+                while(true)
+                {
+                    size_t p = nextPartition++;
+                    if(p >= partitionCount)
+                        return;
+
+                    //start from the largest part so the fewest elements are moved
+                    size_t largest = 0;
+                    for(size_t t=1; t<threadCount; t++)
+                        largest = (parts[t][p].size() > parts[largest][p].size()) ? t : largest;
+                    result[p] = std::move(parts[largest][p]);
+                    for(size_t t=0; t<threadCount; t++)
+                    {
+                        if(t != largest)
+                            result[p].mergeWith(std::move(parts[t][p]), combine);
+                    }
+                    for(Local& local : locals)
+                    {
+                        if(local.bypassed.empty())
+                            continue;
+                        for(std::pair<uint64_t, KeyValueType>& row : local.bypassed[p])
+                            combineInto(result[p], row.first, std::move(row.second));
+                    }
+                }
+            });
+
+            locals = std::vector<Local>(threadCount);
+            return result;
+        }
+
+        /**
+         * @brief Same as finishPartitioned() but returns a single table.
+         *
+         * @return TableType
+         */
+        TableType finish()
+        {
+            std::vector<TableType> partitions = finishPartitioned();
+            TableType result;
+            result.concat(partitions);
+            return result;
+        }
+
+        size_t getThreadCount()
+        {
+            return threadCount;
+        }
+
+        /**
+         * @brief Gets whether a thread stopped aggregating locally because its groups were not reducing the rows enough.
+         *
+         * @param thread
+         * @return bool
+         */
+        bool isBypassing(size_t thread)
+        {
+            return locals[thread].bypassing;
+        }
+
+    private:
+        //aligned so threads updating their own state do not share cache lines
+        struct alignas(64) Local
+        {
+            TableType table;
+            std::vector<std::vector<std::pair<uint64_t, KeyValueType>>> bypassed; //by hash range once bypassing
+            uint64_t rows = 0;
+            bool bypassing = false;
+        };
+
+        void combineInto(TableType& table, uint64_t hash, KeyValueType&& kv)
+        {
+            //insertHashed() does not touch kv if the key already exists
+            uint64_t sizeBefore = table.size();
+            auto it = table.insertHashed(hash, std::move(kv));
+            if(table.size() == sizeBefore)
+                combine(it->second, std::move(kv.second));
+        }
+
+        SimpleHashAggregateOptions options;
+        CombineFunc combine;
+        size_t threadCount = 1;
+        size_t partitionCount = 1;
+        std::vector<Local> locals;
+    };
+}
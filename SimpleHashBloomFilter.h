@@ -0,0 +1,284 @@
+#pragma once
+#include "ImportantInclude.h"
+#include "SimpleHashSerialize.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SMPL_USE_SSE2
+#endif
+
+namespace smpl
+{
+    /**
+     * @brief A blocked Bloom filter over the hashes of a table's keys. Answers "definitely not in the table" without touching the table
+     *      so misses can be rejected before asking a remote shard or reading cold buckets. See SimpleHashTable::make_filter()
+     *
+     *      Every key sets its bits in a single 64 byte block (one cache line) so adding or probing costs one cache miss.
+     *      One bit is set in each of the first k 64 bit words of the block. A probe builds the mask of those bits and compares
+     *      the whole block with SSE2. mayContainHashes() probes many hashes with the blocks prefetched ahead.
+     *
+     *      Probes must use the same hash function as the table. Only the low hashBits bits of a hash are used since that is
+     *      all a table stores (32 unless it is BIG).
+     *
+     */
+    class SimpleHashBloomFilter
+    {
+    public:
+        static constexpr size_t BLOCK_BITS = 512;
+        static constexpr size_t BLOCK_WORDS = BLOCK_BITS / 64;
+
+        SimpleHashBloomFilter(){}
+
+        /**
+         * @brief Construct a new empty filter.
+         *
+         * @param capacity
+         *      Number of keys the filter is sized for. Adding more raises the false positive rate.
+         * @param bitsPerKey
+         *      10 gives about a 2% false positive rate and 16 about 0.1%.
+         * @param hashBits
+         *      32 or 64.
+         */
+        SimpleHashBloomFilter(uint64_t capacity, double bitsPerKey, uint32_t hashBits = 64)
+        {
+            if(hashBits != 32 && hashBits != 64)
+                throw std::runtime_error("INVALID HASH BITS");
+            bitsPerKey = __max(bitsPerKey, 1.0);
+            this->hashBits = hashBits;
+            bitsPerHash = (uint32_t)__max(__min(std::lround(bitsPerKey * 0.6931), (long)BLOCK_WORDS), 1L);
+            uint64_t blockCount = (uint64_t)std::ceil((double)__max(capacity, 1) * bitsPerKey / BLOCK_BITS);
+            blocks = std::vector<Block>(__max(blockCount, 1));
+        }
+
+        void addHash(uint64_t hash)
+        {
+            uint64_t mixed = mix(hash);
+            Block& block = blocks[getBlockIndex(mixed)];
+            alignas(16) uint64_t mask[BLOCK_WORDS];
+            makeMask(mixed, mask);
+            for(size_t i=0; i<BLOCK_WORDS; i++)
+                block.words[i] |= mask[i];
+        }
+
+        /**
+         * @brief Returns false if the hash was never added. True means it probably was.
+         *
+         * @param hash
+         * @return bool
+         */
+        bool mayContainHash(uint64_t hash) const
+        {
+            if(blocks.empty())
+                return false;
+            uint64_t mixed = mix(hash);
+            return blockContains(blocks[getBlockIndex(mixed)], mixed);
+        }
+
+        /**
+         * @brief Hashes key with HashFunc and checks it. HashFunc must be the table's hash function.
+         *
+         * @tparam Key
+         * @tparam HashFunc
+         * @param key
+         * @return bool
+         */
+        template<typename Key, typename HashFunc = TestHashFunction<Key>>
+        bool mayContain(const Key& key) const
+        {
+            return mayContainHash(HashFunc()(key));
+        }
+
+        /**
+         * @brief Checks count hashes at once. result[i] is set to 1 if hashes[i] may have been added and 0 otherwise.
+         *      The blocks of a group are prefetched before any of them are compared so the cache misses overlap.
+         *
+         * @param hashes
+         * @param count
+         * @param result
+         *      Must have room for count entries.
+         */
+        void mayContainHashes(const uint64_t* hashes, size_t count, uint8_t* result) const
+        {
+            if(blocks.empty())
+            {
+                std::memset(result, 0, count);
+                return;
+            }
+            uint64_t mixed[PROBE_BATCH];
+            for(size_t batchStart=0; batchStart<count; batchStart+=PROBE_BATCH)
+            {
+                size_t batchSize = __min(PROBE_BATCH, count - batchStart);
+                for(size_t i=0; i<batchSize; i++)
+                {
+                    mixed[i] = mix(hashes[batchStart+i]);
+                    __builtin_prefetch(&blocks[getBlockIndex(mixed[i])]);
+                }
+                for(size_t i=0; i<batchSize; i++)
+                    result[batchStart+i] = blockContains(blocks[getBlockIndex(mixed[i])], mixed[i]);
+            }
+        }
+
+        /**
+         * @brief Combines another filter of the same size into this one. Afterwards it contains what both contained.
+         *      Throws std::runtime_error if the filters were not made with the same settings.
+         *
+         * @param other
+         */
+        void merge(const SimpleHashBloomFilter& other)
+        {
+            if(other.blocks.size() != blocks.size() || other.hashBits != hashBits || other.bitsPerHash != bitsPerHash)
+                throw std::runtime_error("FILTERS DO NOT MATCH");
+            for(size_t b=0; b<blocks.size(); b++)
+            {
+                for(size_t i=0; i<BLOCK_WORDS; i++)
+                    blocks[b].words[i] |= other.blocks[b].words[i];
+            }
+        }
+
+        void clear()
+        {
+            std::memset((void*)blocks.data(), 0, blocks.size()*sizeof(Block));
+        }
+
+        uint64_t getBlockCount() const
+        {
+            return blocks.size();
+        }
+
+        uint64_t getMemoryUsage() const
+        {
+            return blocks.size()*sizeof(Block);
+        }
+
+        uint32_t getHashBits() const
+        {
+            return hashBits;
+        }
+
+        /**
+         * @brief Writes the filter so it can be sent to whoever does the probing. The stream should be opened in binary mode.
+         *      Like table snapshots, it can only be loaded on a machine with the same endianness.
+         *
+         * @param out
+         */
+        void save(std::ostream& out) const
+        {
+            SimpleHashSnapshotWriter writer(out);
+            writer.write(FILTER_MAGIC, sizeof(FILTER_MAGIC));
+            writer.writeRaw(hashBits);
+            writer.writeRaw(bitsPerHash);
+            writer.writeRaw((uint64_t)blocks.size());
+            writer.write(blocks.data(), blocks.size()*sizeof(Block));
+            writer.finish();
+        }
+
+        /**
+         * @brief Replaces the filter with one written by save().
+         *      Throws std::runtime_error if the data is not a filter, is truncated, or fails its checksum. The filter is left empty in that case.
+         *
+         * @param in
+         */
+        void load(std::istream& in)
+        {
+            blocks = std::vector<Block>();
+            SimpleHashSnapshotReader reader(in);
+            char magic[sizeof(FILTER_MAGIC)];
+            uint32_t newHashBits = 0;
+            uint32_t newBitsPerHash = 0;
+            uint64_t blockCount = 0;
+            reader.read(magic, sizeof(magic));
+            reader.readRaw(newHashBits);
+            reader.readRaw(newBitsPerHash);
+            reader.readRaw(blockCount);
+            if(std::memcmp(magic, FILTER_MAGIC, sizeof(FILTER_MAGIC)) != 0 || (newHashBits != 32 && newHashBits != 64)
+                || newBitsPerHash == 0 || newBitsPerHash > BLOCK_WORDS || blockCount > ((uint64_t)1 << 40))
+                throw std::runtime_error("INVALID FILTER");
+
+            std::vector<Block> newBlocks;
+            if(reader.requireRemaining(blockCount*sizeof(Block)))
+            {
+                newBlocks.resize(blockCount);
+                reader.read(newBlocks.data(), newBlocks.size()*sizeof(Block));
+            }
+            else
+            {
+                //the stream length is unknown so memory only grows as blocks actually arrive
+                while(newBlocks.size() < blockCount)
+                {
+                    size_t start = newBlocks.size();
+                    newBlocks.resize(start + __min(blockCount - start, LOAD_CHUNK_BLOCKS));
+                    reader.read(newBlocks.data() + start, (newBlocks.size() - start)*sizeof(Block));
+                }
+            }
+            reader.finish();
+            hashBits = newHashBits;
+            bitsPerHash = newBitsPerHash;
+            blocks = std::move(newBlocks);
+        }
+
+    private:
+        struct alignas(64) Block
+        {
+            uint64_t words[BLOCK_WORDS] = {};
+        };
+
+        static constexpr size_t PROBE_BATCH = 16;
+        static constexpr size_t LOAD_CHUNK_BLOCKS = 1 << 16;
+        static constexpr char FILTER_MAGIC[8] = {'S', 'M', 'P', 'L', 'B', 'L', 'O', 'M'};
+
+        //tables only store the low 32 bits of a hash (unless BIG) and the integer testHash is a single multiply so the bits are mixed again
+        uint64_t mix(uint64_t hash) const
+        {
+            if(hashBits == 32)
+                hash = (uint32_t)hash;
+            return rapid_mix(hash ^ UINT64_C(0x9E3779B97F4A7C15), UINT64_C(0xD6E8FEB86659FD93));
+        }
+
+        size_t getBlockIndex(uint64_t mixed) const
+        {
+            return (size_t)(((mixed >> 32) * blocks.size()) >> 32);
+        }
+
+        //one bit in each of the first bitsPerHash words picked by 6 bits of the hash each. The block index uses the top 32 bits.
+        void makeMask(uint64_t mixed, uint64_t* mask) const
+        {
+            uint64_t bits = rapid_mix(mixed, UINT64_C(0x8BB84B93962EACC9));
+            for(size_t i=0; i<BLOCK_WORDS; i++)
+                mask[i] = (i < bitsPerHash) ? (uint64_t)1 << ((bits >> (6*i)) & 63) : 0;
+        }
+
+        bool blockContains(const Block& block, uint64_t mixed) const
+        {
+            alignas(16) uint64_t mask[BLOCK_WORDS];
+            makeMask(mixed, mask);
+#ifdef SMPL_USE_SSE2
+            __m128i matches = _mm_set1_epi32(-1);
+            for(size_t i=0; i<BLOCK_WORDS; i+=2)
+            {
+                __m128i b = _mm_load_si128((const __m128i*)&block.words[i]);
+                __m128i m = _mm_load_si128((const __m128i*)&mask[i]);
+                matches = _mm_and_si128(matches, _mm_cmpeq_epi32(_mm_and_si128(b, m), m));
+            }
+            return _mm_movemask_epi8(matches) == 0xFFFF;
+#else
+            for(size_t i=0; i<BLOCK_WORDS; i++)
+            {
+                if((block.words[i] & mask[i]) != mask[i])
+                    return false;
+            }
+            return true;
+#endif
+        }
+
+        uint32_t hashBits = 64;
+        uint32_t bitsPerHash = 1;
+        std::vector<Block> blocks;
+    };
+}
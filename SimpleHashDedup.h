@@ -0,0 +1,282 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include "SimpleHashSpillFiles.h"
+#include <fstream>
+#include <string>
+
+namespace smpl
+{
+    struct SimpleHashDedupOptions
+    {
+        //Bytes the tables may use (see SimpleHashTable::getMemoryUsage()). 0 keeps everything in one table in memory (exact mode).
+        uint64_t memoryBudget = 0;
+
+        //Where partitions are written once the memory budget is used. Only used if memoryBudget is not 0.
+        std::string spillDirectory = ".";
+
+        //Number of partitions keys are split into if memoryBudget is not 0. Rounded up to a power of 2.
+        size_t partitionCount = 64;
+
+        //Lookups are prefetched this many at a time.
+        size_t batchSize = 16;
+    };
+
+    /**
+     * @brief Removes duplicates from a stream of keys given in batches. process() marks which keys of a batch were never seen before
+     *      (in this batch or any before it). Every key of a batch is hashed first and the lookups are prefetched in groups
+     *      so the cache misses overlap.
+     *
+     *      With a memory budget, keys are split into partitions by the high bits of their hash. A batch is processed one partition at a time.
+     *      Partitions that were not used recently are written to a file in the spill directory and freed when the budget is exceeded,
+     *      and read back when a later batch has keys for them. Results are still exact. Only keys added since a partition was last
+     *      loaded are appended to its file so each key is written once. Larger batches touch each partition fewer times.
+     *
+     *      Keys are written as raw bytes when trivially copyable and through SimpleHashSerializer otherwise.
+     *
+     * @tparam Key
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     */
+    template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    class SimpleHashDeduplicator
+    {
+    public:
+        using TableType = SimpleHashSet<Key, HashFunc, KeyEqual>;
+
+        /**
+         * @brief Construct a new Simple Hash Deduplicator.
+         *      Throws std::runtime_error if the spill directory can not be created.
+         *
+         * @param options
+         */
+        SimpleHashDeduplicator(SimpleHashDedupOptions options = SimpleHashDedupOptions())
+        {
+            this->options = options;
+            this->options.batchSize = __max(options.batchSize, 1);
+            if(options.memoryBudget != 0)
+            {
+                while(((size_t)1 << partitionBits) < options.partitionCount)
+                    partitionBits++;
+                spillFiles.open(options.spillDirectory, "dedup");
+            }
+            partitions = std::vector<Partition>((size_t)1 << partitionBits);
+        }
+
+        SimpleHashDeduplicator(const SimpleHashDeduplicator& other) = delete;
+        SimpleHashDeduplicator& operator=(const SimpleHashDeduplicator& other) = delete;
+
+        /**
+         * @brief Processes a batch of keys. firstSeen[i] is set to 1 if keys[i] was never seen before and 0 otherwise.
+         *      Only the first of several equal keys in the same batch is marked.
+         *
+         * @param keys
+         * @param count
+         * @param firstSeen
+         *      Must have room for count entries.
+         * @return uint64_t
+         *      The number of keys that were seen for the first time.
+         */
+        uint64_t process(const Key* keys, size_t count, uint8_t* firstSeen)
+        {
+            hashes.resize(count);
+            for(size_t i=0; i<count; i++)
+                hashes[i] = partitions[0].table.hashKey(keys[i]);
+
+            uint64_t sizeBefore = totalKeys;
+            if(partitions.size() == 1)
+            {
+                order.resize(count);
+                for(size_t i=0; i<count; i++)
+                    order[i] = i;
+                probe(partitions[0], keys, order.data(), count, firstSeen);
+                return totalKeys - sizeBefore;
+            }
+
+            //group the batch by partition. Keeps the batch order within a partition so the first equal key is the one marked.
+            std::vector<size_t> offsets(partitions.size()+1);
+            for(size_t i=0; i<count; i++)
+                offsets[getPartitionIndex(hashes[i])+1]++;
+            for(size_t p=0; p<partitions.size(); p++)
+                offsets[p+1] += offsets[p];
+            order.resize(count);
+            std::vector<size_t> positions(offsets.begin(), offsets.end()-1);
+            for(size_t i=0; i<count; i++)
+                order[positions[getPartitionIndex(hashes[i])]++] = i;
+
+            for(size_t p=0; p<partitions.size(); p++)
+            {
+                if(offsets[p] == offsets[p+1])
+                    continue;
+                loadPartition(p);
+                probe(partitions[p], keys, order.data() + offsets[p], offsets[p+1] - offsets[p], firstSeen);
+                partitions[p].lastUsed = ++useCounter;
+                spillUntilUnderBudget(p);
+            }
+            return totalKeys - sizeBefore;
+        }
+
+        /**
+         * @brief Same as process(const Key*, size_t, uint8_t*) but returns the selection mask.
+         *
+         * @param keys
+         * @return std::vector<uint8_t>
+         */
+        std::vector<uint8_t> process(const std::vector<Key>& keys)
+        {
+            std::vector<uint8_t> firstSeen(keys.size());
+            process(keys.data(), keys.size(), firstSeen.data());
+            return firstSeen;
+        }
+
+        /**
+         * @brief Gets the number of distinct keys seen.
+         *
+         * @return uint64_t
+         */
+        uint64_t size()
+        {
+            return totalKeys;
+        }
+
+        /**
+         * @brief Gets the bytes used by the partitions in memory. See SimpleHashTable::getMemoryUsage()
+         *
+         * @return uint64_t
+         */
+        uint64_t getMemoryUsage()
+        {
+            return memoryUsed;
+        }
+
+        /**
+         * @brief Gets the number of partitions currently written to disk and not in memory.
+         *
+         * @return size_t
+         */
+        size_t getSpilledPartitionCount()
+        {
+            size_t count = 0;
+            for(Partition& p : partitions)
+                count += !p.inMemory;
+            return count;
+        }
+
+    private:
+        struct Partition
+        {
+            TableType table;
+            uint64_t keysInFile = 0; //the first keysInFile keys of the table are already in the file
+            uint64_t lastUsed = 0;
+            bool inMemory = true;
+        };
+
+        void probe(Partition& partition, const Key* keys, const size_t* indices, size_t count, uint8_t* firstSeen)
+        {
+            TableType& table = partition.table;
+            uint64_t usageBefore = table.getMemoryUsage();
+            for(size_t batchStart=0; batchStart<count; batchStart+=options.batchSize)
+            {
+                size_t batchEnd = __min(batchStart + options.batchSize, count);
+                for(size_t i=batchStart; i<batchEnd; i++)
+                    table.prefetch(hashes[indices[i]]);
+
+                for(size_t i=batchStart; i<batchEnd; i++)
+                {
+                    size_t index = indices[i];
+                    //look up first so duplicates (usually most of a stream) never copy the key
+                    bool isNew = table.findHashed(hashes[index], keys[index]) == table.end();
+                    if(isNew)
+                    {
+                        table.insertHashed(hashes[index], Key(keys[index]));
+                        totalKeys++;
+                    }
+                    firstSeen[index] = isNew;
+                }
+            }
+            memoryUsed += table.getMemoryUsage() - usageBefore;
+        }
+
+        size_t getPartitionIndex(uint64_t hash)
+        {
+            //the tables use the low bits to pick buckets so the high bits are used here
+            return (partitionBits == 0) ? 0 : (size_t)(hash >> (64 - partitionBits));
+        }
+
+        void spillUntilUnderBudget(size_t current)
+        {
+            while(memoryUsed > options.memoryBudget)
+            {
+                size_t oldest = partitions.size();
+                for(size_t i=0; i<partitions.size(); i++)
+                {
+                    if(i != current && partitions[i].inMemory && partitions[i].table.size() != 0
+                        && (oldest == partitions.size() || partitions[i].lastUsed < partitions[oldest].lastUsed))
+                        oldest = i;
+                }
+                if(oldest == partitions.size())
+                    return; //only the partition in use is left. It must fit.
+                spillPartition(oldest);
+            }
+        }
+
+        void spillPartition(size_t index)
+        {
+            Partition& p = partitions[index];
+            std::fstream& file = spillFiles.getFile(index);
+
+            //keys keep their insertion order since nothing is erased so only the ones after keysInFile are new
+            file.seekp(0, std::ios::end);
+            uint64_t i = 0;
+            for(const Key& key : p.table)
+            {
+                if(i++ >= p.keysInFile)
+                    SimpleHashSpillFiles::writeItem(file, key);
+            }
+            file.flush();
+            if(!file)
+                throw std::runtime_error("SPILL WRITE FAILED");
+
+            p.keysInFile = p.table.size();
+            memoryUsed -= p.table.getMemoryUsage();
+            p.table = TableType(); //clear() keeps the element array's capacity so getMemoryUsage() would not drop below the budget
+            p.inMemory = false;
+        }
+
+        void loadPartition(size_t index)
+        {
+            Partition& p = partitions[index];
+            if(p.inMemory)
+                return;
+
+            std::fstream& file = spillFiles.getFile(index);
+            file.clear();
+            file.seekg(0);
+            uint64_t usageBefore = p.table.getMemoryUsage();
+            p.table.reserve(p.keysInFile);
+            {
+                SimpleHashSnapshotReader reader(file);
+                for(uint64_t i=0; i<p.keysInFile; i++)
+                {
+                    Key key = SimpleHashSerializer<Key>::read(reader);
+                    uint64_t hash = p.table.hashKey(key);
+                    p.table.insertHashed(hash, std::move(key));
+                }
+            }
+            memoryUsed += p.table.getMemoryUsage() - usageBefore;
+            p.inMemory = true;
+        }
+
+        SimpleHashDedupOptions options;
+        std::vector<Partition> partitions;
+        size_t partitionBits = 0;
+        uint64_t totalKeys = 0;
+        uint64_t useCounter = 0;
+        uint64_t memoryUsed = 0; //sum of getMemoryUsage() of every partition in memory. Updated as they change
+
+        //reused between batches
+        std::vector<uint64_t> hashes;
+        std::vector<size_t> order;
+
+        SimpleHashSpillFiles spillFiles;
+    };
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <thread>
+
+namespace smpl
+{
+    /**
+     * @brief Estimates the number of distinct keys with a HyperLogLog sketch.
+     *      Keys are hashed with the same HashFunc the tables use (TestHashFunction by default) so hashes from SimpleHashTable::hashKey()
+     *      can be added directly and the estimate describes the keys exactly the way a table would see them.
+     *      Uses 2^precision bytes. The typical error is 1.04 / sqrt(2^precision) (about 0.8% for the default of 14).
+     *
+     *      Sketches built separately (like one per thread) are combined with merge() or mergeAll(). Merging takes the max of every
+     *      register 16 at a time with SSE2.
+     *
+     * @tparam Key
+     * @tparam HashFunc
+     */
+    template<typename Key, typename HashFunc = TestHashFunction<Key>>
+    class SimpleHashHyperLogLog
+    {
+    public:
+        /**
+         * @brief Construct a new sketch.
+         *      Throws std::runtime_error if precision is not between 4 and 18.
+         *
+         * @param precision
+         */
+        SimpleHashHyperLogLog(uint32_t precision = 14)
+        {
+            if(precision < 4 || precision > 18)
+                throw std::runtime_error("INVALID PRECISION");
+            this->precision = precision;
+            registers = std::vector<uint8_t>((size_t)1 << precision);
+        }
+
+        void add(const Key& key)
+        {
+            addHashed(hasher(key));
+        }
+
+        /**
+         * @brief Adds a hash that was already computed with HashFunc (like from SimpleHashTable::hashKey()).
+         *
+         * @param hash
+         */
+        void addHashed(uint64_t hash)
+        {
+            //testHash for integers is a single multiply which spreads consecutive keys too evenly for counting leading zeros
+            //  so the hash gets a finalizer first (the one from MurmurHash3).
+            hash ^= hash >> 33;
+            hash *= UINT64_C(0xFF51AFD7ED558CCD);
+            hash ^= hash >> 33;
+            hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+            hash ^= hash >> 33;
+
+            size_t index = (size_t)(hash >> (64 - precision));
+            uint64_t rest = (hash << precision) | ((uint64_t)1 << (precision-1)); //stops the count before it reaches the index bits
+            uint8_t rank = (uint8_t)std::countl_zero(rest) + 1;
+            registers[index] = __max(registers[index], rank);
+        }
+
+        template<typename InputIt>
+        void addAll(InputIt first, InputIt last)
+        {
+            for(; first != last; ++first)
+                add(*first);
+        }
+
+        /**
+         * @brief Combines another sketch into this one. The result is the same as adding every key of both.
+         *      Throws std::runtime_error if the precisions are different.
+         *
+         * @param other
+         */
+        void merge(const SimpleHashHyperLogLog& other)
+        {
+            if(other.precision != precision)
+                throw std::runtime_error("PRECISION DOES NOT MATCH");
+            mergeRegisters(registers.data(), other.registers.data(), 0, registers.size());
+        }
+
+        /**
+         * @brief Combines many sketches at once. The registers are split between threads and each thread merges its part of
+         *      every sketch so no thread waits on another.
+         *      Throws std::runtime_error if the sketches are empty or their precisions are different.
+         *
+         * @param sketches
+         * @param threads
+         *      0 uses one per hardware thread.
+         * @return SimpleHashHyperLogLog
+         */
+        static SimpleHashHyperLogLog mergeAll(const std::vector<SimpleHashHyperLogLog>& sketches, size_t threads = 0)
+        {
+            if(sketches.empty())
+                throw std::runtime_error("NOTHING TO MERGE");
+            SimpleHashHyperLogLog result(sketches[0].precision);
+            for(const SimpleHashHyperLogLog& sketch : sketches)
+            {
+                if(sketch.precision != result.precision)
+                    throw std::runtime_error("PRECISION DOES NOT MATCH");
+            }
+
+            size_t registerCount = result.registers.size();
+            if(threads == 0)
+                threads = __max(std::thread::hardware_concurrency(), 1);
+            threads = __max(__min(threads, registerCount / 4096), 1);
+            size_t perThread = registerCount / threads; //register counts are powers of 2 so this stays a multiple of 16
+
+            auto mergeSlice = [&](size_t start, size_t end)
+            {
+                for(const SimpleHashHyperLogLog& sketch : sketches)
+                    mergeRegisters(result.registers.data(), sketch.registers.data(), start, end);
+            };
+            std::vector<std::thread> workers;
+            for(size_t t=1; t<threads; t++)
+                workers.emplace_back(mergeSlice, t*perThread, (t+1 == threads) ? registerCount : (t+1)*perThread);
+            mergeSlice(0, (threads == 1) ? registerCount : perThread);
+            for(std::thread& t : workers)
+                t.join();
+            return result;
+        }
+
+        /**
+         * @brief Gets the estimated number of distinct keys added.
+         *
+         * @return uint64_t
+         */
+        uint64_t estimate() const
+        {
+            double m = (double)registers.size();
+            double sum = 0;
+            size_t zeros = 0;
+            for(uint8_t r : registers)
+            {
+                sum += std::ldexp(1.0, -(int)r);
+                zeros += (r == 0);
+            }
+
+            double alpha = 0.7213 / (1.0 + 1.079 / m);
+            double e = alpha * m * m / sum;
+            if(e <= 2.5*m && zeros != 0)
+                e = m * std::log(m / (double)zeros); //linear counting is more accurate while many registers are empty
+            return (uint64_t)(e + 0.5);
+        }
+
+        void clear()
+        {
+            std::fill(registers.begin(), registers.end(), 0);
+        }
+
+        uint32_t getPrecision() const
+        {
+            return precision;
+        }
+
+        /**
+         * @brief Inserts [first, last) into table after reserving space for the number of distinct keys in it.
+         *      Every key is hashed once with table.hashKey(). The hashes feed a sketch, the table reserves the estimate plus a margin for
+         *      the sketch's error, then the elements are inserted with insertHashed(). Duplicates do not make the table oversized
+         *      the way reserving for the number of elements would and the table never rehashes part way through.
+         *      For integer keys the smallest and largest key are tracked too so the table starts in dense mode instead when the
+         *      estimate fills enough of their range (see SimpleHashTable::reserve(count, minKey, maxKey)).
+         *
+         * @tparam Table
+         * @tparam ForwardIt
+         *      Iterates over the table's KeyValueType. Must be a forward iterator since the range is walked twice
+         *      (once for the sketch and once to insert). Copy single pass input into a container first.
+         * @param table
+         * @param first
+         * @param last
+         * @param precision
+         * @return uint64_t
+         *      The estimated number of distinct keys.
+         */
+        template<typename Table, typename ForwardIt>
+        static uint64_t bulkInsert(Table& table, ForwardIt first, ForwardIt last, uint32_t precision = 14)
+        {
+            static_assert(std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<ForwardIt>::iterator_category>,
+                "bulkInsert walks the range twice so it needs a forward iterator");
+            using KeyType = typename Table::KeyType;
+            using KeyValueType = typename Table::KeyValueType;
+            std::vector<uint64_t> hashes;
+            SimpleHashHyperLogLog sketch(precision);
+            KeyType minKey = KeyType();
+            KeyType maxKey = KeyType();
+            for(ForwardIt it = first; it != last; ++it)
+            {
+                const KeyValueType& v = *it;
+                const KeyType* key;
+                if constexpr(std::is_same_v<KeyValueType, KeyType>)
+                    key = &v;
+                else
+                    key = &v.first;
+                hashes.push_back(table.hashKey(*key));
+                sketch.addHashed(hashes.back());
+                if constexpr(std::is_integral_v<KeyType>)
+                {
+                    minKey = (hashes.size() == 1 || *key < minKey) ? *key : minKey;
+                    maxKey = (hashes.size() == 1 || *key > maxKey) ? *key : maxKey;
+                }
+            }
+
+            uint64_t distinct = sketch.estimate();
+            double margin = 1.0 + 3.0 * 1.04 / std::sqrt((double)sketch.registers.size()); //3 standard errors
+            uint64_t count = table.size() + (uint64_t)(distinct * margin);
+            if constexpr(std::is_integral_v<KeyType>)
+            {
+                if(!hashes.empty())
+                    table.reserve(count, minKey, maxKey);
+            }
+            else
+                table.reserve(count);
+            size_t i = 0;
+            for(ForwardIt it = first; it != last; ++it)
+                table.insertHashed(hashes[i++], KeyValueType(*it));
+            return distinct;
+        }
+
+    private:
+        static void mergeRegisters(uint8_t* dst, const uint8_t* src, size_t start, size_t end)
+        {
+            size_t i = start;
+#ifdef SMPL_USE_SSE2
+            for(; i+16 <= end; i+=16)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_max_epu8(a, b));
+            }
+#endif
+            for(; i<end; i++)
+                dst[i] = __max(dst[i], src[i]);
+        }
+
+        uint32_t precision = 14;
+        std::vector<uint8_t> registers;
+        HashFunc hasher;
+    };
+}
@@ -0,0 +1,222 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include <atomic>
+#include <thread>
+
+namespace smpl
+{
+    enum class SimpleHashJoinType
+    {
+        INNER, //every matching pair of rows
+        SEMI, //probe rows with at least one match. Each is output once
+        ANTI //probe rows with no match
+    };
+
+    struct SimpleHashJoinOptions
+    {
+        //Threads joining partitions. 0 uses one per hardware thread.
+        size_t threads = 0;
+
+        //Number of radix partitions is 2^partitionBits. 0 picks enough partitions for each partition's table to stay in cache.
+        size_t partitionBits = 0;
+
+        //Probe lookups are prefetched this many at a time.
+        size_t batchSize = 16;
+    };
+
+    /**
+     * @brief Joins two in memory relations on a key with a partitioned hash join.
+     *      Both sides are hashed once and split into radix partitions by the high bits of the hash. Every partition of the build side
+     *      gets its own SimpleHashMap which is small enough to stay in cache while the matching partition of the probe side is looked up.
+     *      The table maps each key to the first build row with that key and the rest are chained through an array of row indices
+     *      so duplicate keys on the build side cost 4 bytes each instead of a list node.
+     *      Probe lookups use the hashes from partitioning (findHashed()) and are prefetched a batch at a time.
+     *      Partitions are joined in parallel.
+     *      Keys are copied while partitioning so Key must be copyable and default constructible.
+     *
+     * @tparam Key
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     */
+    template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    class SimpleHashJoin
+    {
+    public:
+        /**
+         * @brief Joins build and probe. The smaller relation should be the build side.
+         *      output is called as output(size_t thread, const ProbeRow& probeRow, const BuildRow* buildRow) from the joining threads.
+         *          thread is less than the number of threads used so it can index per thread results without locking.
+         *          buildRow is the matching row for INNER joins and nullptr for SEMI and ANTI joins.
+         *      Output order is not defined. Exceptions thrown by any function are rethrown once every thread stops.
+         *      Throws std::runtime_error if the build side has 2^32 rows or more.
+         *
+         * @tparam BuildRow
+         * @tparam ProbeRow
+         * @tparam BuildKeyFunc
+         *      Returns the Key of a BuildRow.
+         * @tparam ProbeKeyFunc
+         *      Returns the Key of a ProbeRow.
+         * @tparam OutputFunc
+         * @param build
+         * @param buildKey
+         * @param probe
+         * @param probeKey
+         * @param type
+         * @param output
+         * @param options
+         */
+        template<typename BuildRow, typename ProbeRow, typename BuildKeyFunc, typename ProbeKeyFunc, typename OutputFunc>
+        static void join(const std::vector<BuildRow>& build, BuildKeyFunc buildKey,
+                        const std::vector<ProbeRow>& probe, ProbeKeyFunc probeKey,
+                        SimpleHashJoinType type, OutputFunc output, SimpleHashJoinOptions options = SimpleHashJoinOptions())
+        {
+            if(build.size() >= NO_ROW)
+                throw std::runtime_error("TOO LARGE");
+
+            size_t threadCount = options.threads != 0 ? options.threads : __max(std::thread::hardware_concurrency(), 1);
+            size_t partitionBits = options.partitionBits;
+            if(partitionBits == 0)
+            {
+                while(partitionBits < MAX_PARTITION_BITS && (build.size() >> partitionBits) > ROWS_PER_PARTITION)
+                    partitionBits++;
+            }
+            partitionBits = __min(partitionBits, MAX_PARTITION_BITS);
+            size_t batchSize = __max(options.batchSize, 1);
+
+            Partitioned buildSide = partition(build, buildKey, partitionBits, threadCount);
+            Partitioned probeSide = partition(probe, probeKey, partitionBits, threadCount);
+
+            std::vector<uint32_t> nextRow(build.size()); //next build row with the same key
+            std::atomic<size_t> nextPartition = 0;
+            size_t partitionCount = (size_t)1 << partitionBits;
+
+            runSimpleHashThreads(threadCount, [&](size_t thread)
+            {
+                std::vector<Iterator> found(batchSize);
+                while(true)
+                {
+                    size_t p = nextPartition++;
+                    if(p >= partitionCount)
+                        return;
+
+                    size_t buildStart = buildSide.offsets[p];
+                    size_t buildEnd = buildSide.offsets[p+1];
+                    TableType table;
+                    table.reserve(buildEnd - buildStart);
+                    for(size_t i=buildStart; i<buildEnd; i++)
+                    {
+                        uint32_t row = (uint32_t)buildSide.rows[i].second;
+                        uint64_t sizeBefore = table.size();
+                        auto it = table.insertHashed(buildSide.rows[i].first, {std::move(buildSide.keys[i]), row});
+                        nextRow[row] = NO_ROW;
+                        if(table.size() == sizeBefore)
+                        {
+                            //key already exists. Chain the row after the first one.
+                            nextRow[row] = nextRow[it->second];
+                            nextRow[it->second] = row;
+                        }
+                    }
+
+                    size_t probeEnd = probeSide.offsets[p+1];
+                    for(size_t batchStart=probeSide.offsets[p]; batchStart<probeEnd; batchStart+=batchSize)
+                    {
+                        size_t batchEnd = __min(batchStart + batchSize, probeEnd);
+                        for(size_t i=batchStart; i<batchEnd; i++)
+                            table.prefetch(probeSide.rows[i].first);
+                        for(size_t i=batchStart; i<batchEnd; i++)
+                            found[i-batchStart] = table.findHashed(probeSide.rows[i].first, probeSide.keys[i]);
+
+                        for(size_t i=batchStart; i<batchEnd; i++)
+                        {
+                            const ProbeRow& probeRow = probe[probeSide.rows[i].second];
+                            Iterator& it = found[i-batchStart];
+                            if(type == SimpleHashJoinType::INNER)
+                            {
+                                if(it == table.end())
+                                    continue;
+                                for(uint32_t row = it->second; row != NO_ROW; row = nextRow[row])
+                                    output(thread, probeRow, &build[row]);
+                            }
+                            else if((it != table.end()) == (type == SimpleHashJoinType::SEMI))
+                                output(thread, probeRow, (const BuildRow*)nullptr);
+                        }
+                    }
+                }
+            });
+        }
+
+    private:
+        using TableType = SimpleHashMap<Key, uint32_t, HashFunc, KeyEqual>;
+        using Iterator = typename TableType::Iterator;
+
+        static constexpr uint32_t NO_ROW = UINT32_MAX;
+        static constexpr size_t MAX_PARTITION_BITS = 12;
+        static constexpr size_t ROWS_PER_PARTITION = 1<<15; //about 1MB of table per partition for small keys
+
+        //(hash, row index) and the key of every row grouped by partition. Partition p is [offsets[p], offsets[p+1])
+        //The keys are copied so joining a partition reads them in order instead of jumping around the rows.
+        struct Partitioned
+        {
+            std::vector<std::pair<uint64_t, size_t>> rows;
+            std::vector<Key> keys;
+            std::vector<size_t> offsets;
+        };
+
+        template<typename Row, typename KeyFunc>
+        static Partitioned partition(const std::vector<Row>& rows, KeyFunc& keyFunc, size_t partitionBits, size_t threadCount)
+        {
+            size_t partitionCount = (size_t)1 << partitionBits;
+            threadCount = __max(__min(threadCount, rows.size() / 4096), 1);
+            size_t perThread = (rows.size() + threadCount - 1) / threadCount;
+            std::vector<uint64_t> hashes(rows.size());
+            std::vector<std::vector<size_t>> counts(threadCount, std::vector<size_t>(partitionCount));
+
+            //the tables use the low bits of the hash to pick buckets so the partition uses the high bits
+            auto getPartition = [partitionBits](uint64_t hash)
+            {
+                return (partitionBits == 0) ? 0 : (size_t)(hash >> (64 - partitionBits));
+            };
+
+            runSimpleHashThreads(threadCount, [&](size_t thread)
+            {
+                HashFunc hasher;
+                size_t end = __min((thread+1)*perThread, rows.size());
+                for(size_t i=thread*perThread; i<end; i++)
+                {
+                    hashes[i] = hasher(keyFunc(rows[i]));
+                    counts[thread][getPartition(hashes[i])]++;
+                }
+            });
+
+            //each thread writes its rows of a partition after the rows of the threads before it so the order is stable
+            Partitioned result;
+            result.rows.resize(rows.size());
+            result.keys.resize(rows.size());
+            result.offsets.resize(partitionCount+1);
+            size_t total = 0;
+            for(size_t p=0; p<partitionCount; p++)
+            {
+                result.offsets[p] = total;
+                for(size_t t=0; t<threadCount; t++)
+                {
+                    size_t count = counts[t][p];
+                    counts[t][p] = total;
+                    total += count;
+                }
+            }
+            result.offsets[partitionCount] = total;
+
+            runSimpleHashThreads(threadCount, [&](size_t thread)
+            {
+                size_t end = __min((thread+1)*perThread, rows.size());
+                for(size_t i=thread*perThread; i<end; i++)
+                {
+                    size_t position = counts[thread][getPartition(hashes[i])]++;
+                    result.rows[position] = {hashes[i], i};
+                    result.keys[position] = keyFunc(rows[i]);
+                }
+            });
+            return result;
+        }
+    };
+}
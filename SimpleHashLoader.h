@@ -0,0 +1,403 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include "SimpleHashMappedFile.h"
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace smpl
+{
+    struct SimpleHashLoadOptions
+    {
+        //Number of threads parsing the file. 0 uses one per hardware thread.
+        size_t threads = 0;
+
+        //Number of threads inserting (including the calling thread). 0 uses one per hardware thread.
+        //  With more than one, each builds the part of the table for its own hash range and the parts are joined with concat() at the end.
+        //  Multimaps and other table types are always inserted into by the calling thread alone.
+        size_t insertThreads = 0;
+
+        //Approximate number of bytes each thread parses at a time.
+        size_t chunkBytes = 4<<20;
+
+        //Passed to reserve() before loading. Record files compute this from the file size when it is 0.
+        uint64_t expectedRecords = 0;
+    };
+
+    struct SimpleHashLoadResult
+    {
+        uint64_t records = 0; //records parsed successfully. Includes duplicate keys that were not inserted
+        uint64_t skipped = 0; //non empty lines or records the parser rejected
+    };
+
+    /**
+     * @brief Parses a line of delimited text (tab separated by default) into a Key or std::pair<Key, Value>.
+     *      Arithmetic fields are parsed with std::from_chars. Anything else must be constructible from std::string_view.
+     *      Fields after the ones needed are ignored. Returns nothing if a field is missing or invalid.
+     *
+     * @tparam KeyValueType
+     */
+    template<typename KeyValueType>
+    struct SimpleHashTextParser
+    {
+        char delimiter = '\t';
+
+        std::optional<KeyValueType> operator()(std::string_view line) const
+        {
+            KeyValueType result;
+            std::string_view field = line.substr(0, line.find(delimiter));
+            if(!parseField(field, result))
+                return std::nullopt;
+            return result;
+        }
+
+        template<typename T>
+        static bool parseField(std::string_view text, T& out)
+        {
+            if constexpr(std::is_arithmetic_v<T>)
+            {
+                std::from_chars_result r = std::from_chars(text.data(), text.data() + text.size(), out);
+                return r.ec == std::errc() && r.ptr == text.data() + text.size();
+            }
+            else
+            {
+                out = T(text);
+                return true;
+            }
+        }
+    };
+
+    template<typename Key, typename Value>
+    struct SimpleHashTextParser<std::pair<Key, Value>>
+    {
+        char delimiter = '\t';
+
+        std::optional<std::pair<Key, Value>> operator()(std::string_view line) const
+        {
+            size_t split = line.find(delimiter);
+            if(split == std::string_view::npos)
+                return std::nullopt;
+            std::string_view valueField = line.substr(split+1);
+            valueField = valueField.substr(0, valueField.find(delimiter));
+
+            std::pair<Key, Value> result;
+            if(!SimpleHashTextParser<Key>::parseField(line.substr(0, split), result.first)
+                || !SimpleHashTextParser<Value>::parseField(valueField, result.second))
+                return std::nullopt;
+            return result;
+        }
+    };
+
+    //tables the loader can build in parts by hash range and join with concat(). Multimaps can't be merged.
+    template<typename Table>
+    struct is_part_loadable : std::false_type {};
+
+    template<typename Key, typename Value, typename HashFunc, typename KeyEqual, bool BIG>
+    struct is_part_loadable<SimpleHashTable<Key, Value, false, HashFunc, KeyEqual, BIG>> : std::true_type {};
+
+    /**
+     * @brief Builds a table from a large file using multiple threads.
+     *      The file is memory mapped and split into chunks. Worker threads parse chunks, hash every key, and sort the records of a
+     *      chunk by hash range. Each insert thread takes its own range from every chunk in file order and inserts it into its own
+     *      part of the table with the hashes already computed. The parts cover different keys so they never need a lock.
+     *      Parsing and inserting overlap so the load is limited by how fast the file can be read, not by parsing or a single insert.
+     *      Only a few chunks are parsed ahead of the slowest insert thread so memory use does not grow with the file size.
+     *
+     *      The parts are joined with concat() once everything is inserted. That reuses the stored hashes but runs on the calling
+     *      thread so it is the part of a load that does not scale with threads.
+     *
+     *      Like insert(), the first record with a key wins and keys already in the table are kept.
+     */
+    class SimpleHashLoader
+    {
+    public:
+        /**
+         * @brief Loads a text file with one record per line. Lines may end with "\n" or "\r\n". Empty lines are ignored.
+         *      parser is called from several threads at once and must return std::optional<KeyValueType>.
+         *          See SimpleHashTextParser for the default.
+         *
+         * @tparam Table
+         * @tparam Parser
+         * @param table
+         * @param filename
+         * @param parser
+         * @param options
+         * @return SimpleHashLoadResult
+         */
+        template<typename Table, typename Parser = SimpleHashTextParser<typename Table::KeyValueType>>
+        static SimpleHashLoadResult loadDelimited(Table& table, const std::string& filename, Parser parser = Parser(), SimpleHashLoadOptions options = SimpleHashLoadOptions())
+        {
+            SimpleHashMappedFile file(filename);
+            file.adviseSequential();
+            const char* text = (const char*)file.data();
+            size_t textSize = file.size();
+
+            //a chunk parses every line that starts inside of it
+            auto parseChunk = [&](size_t start, size_t end, std::vector<HashedItem<Table>>& items, uint64_t& skipped)
+            {
+                if(start != 0 && text[start-1] != '\n')
+                {
+                    const char* lineEnd = (const char*)std::memchr(text + start, '\n', textSize - start);
+                    start = (lineEnd == nullptr) ? textSize : (size_t)(lineEnd - text) + 1;
+                }
+                while(start < end)
+                {
+                    const char* lineEnd = (const char*)std::memchr(text + start, '\n', textSize - start);
+                    size_t next = (lineEnd == nullptr) ? textSize : (size_t)(lineEnd - text);
+                    std::string_view line(text + start, next - start);
+                    if(!line.empty() && line.back() == '\r')
+                        line.remove_suffix(1);
+                    if(!line.empty())
+                        addItem(table, parser(line), items, skipped);
+                    start = next + 1;
+                }
+            };
+            return run(table, textSize, options.chunkBytes, options, options.expectedRecords, parseChunk);
+        }
+
+        /**
+         * @brief Loads a file of fixed size binary records.
+         *      decoder is called from several threads at once with a pointer to each record and must return std::optional<KeyValueType>.
+         *      Throws std::runtime_error if the file size is not a multiple of recordSize.
+         *
+         * @tparam Table
+         * @tparam Decoder
+         * @param table
+         * @param filename
+         * @param recordSize
+         * @param decoder
+         * @param options
+         * @return SimpleHashLoadResult
+         */
+        template<typename Table, typename Decoder>
+        static SimpleHashLoadResult loadRecords(Table& table, const std::string& filename, size_t recordSize, Decoder decoder, SimpleHashLoadOptions options = SimpleHashLoadOptions())
+        {
+            SimpleHashMappedFile file(filename);
+            file.adviseSequential();
+            if(recordSize == 0 || file.size() % recordSize != 0)
+                throw std::runtime_error("INVALID RECORD FILE");
+
+            uint64_t expectedRecords = options.expectedRecords != 0 ? options.expectedRecords : file.size() / recordSize;
+            const uint8_t* data = file.data();
+            auto parseChunk = [&](size_t start, size_t end, std::vector<HashedItem<Table>>& items, uint64_t& skipped)
+            {
+                for(size_t offset=start; offset<end; offset+=recordSize)
+                    addItem(table, decoder(data + offset), items, skipped);
+            };
+            size_t chunkBytes = __max(options.chunkBytes / recordSize, 1) * recordSize;
+            return run(table, file.size(), chunkBytes, options, expectedRecords, parseChunk);
+        }
+
+        /**
+         * @brief Loads a file that is just an array of KeyValueType (the Key or std::pair<Key, Value>) written as raw bytes.
+         *
+         * @tparam Table
+         * @param table
+         * @param filename
+         * @param options
+         * @return SimpleHashLoadResult
+         */
+        template<typename Table>
+        static SimpleHashLoadResult loadRecords(Table& table, const std::string& filename, SimpleHashLoadOptions options = SimpleHashLoadOptions())
+        {
+            using KeyValueType = typename Table::KeyValueType;
+            static_assert(is_raw_serializable_v<KeyValueType> && std::is_default_constructible_v<KeyValueType>, "Records must be trivially copyable");
+            auto decoder = [](const uint8_t* record)
+            {
+                std::optional<KeyValueType> result(std::in_place);
+                std::memcpy((void*)&*result, record, sizeof(KeyValueType));
+                return result;
+            };
+            return loadRecords(table, filename, sizeof(KeyValueType), decoder, options);
+        }
+
+    private:
+        template<typename Table>
+        using HashedItem = std::pair<uint64_t, typename Table::KeyValueType>;
+
+        template<typename Table>
+        static void addItem(Table& table, std::optional<typename Table::KeyValueType>&& parsed, std::vector<HashedItem<Table>>& items, uint64_t& skipped)
+        {
+            if(!parsed)
+            {
+                skipped++;
+                return;
+            }
+            uint64_t hash;
+            if constexpr(std::is_same_v<typename Table::KeyValueType, typename Table::KeyType>)
+                hash = table.hashKey(*parsed);
+            else
+                hash = table.hashKey(parsed->first);
+            items.emplace_back(hash, std::move(*parsed));
+        }
+
+        template<typename Table>
+        struct Chunk
+        {
+            std::vector<std::vector<HashedItem<Table>>> parts; //records by hash range
+            size_t remaining = 0; //insert threads that have not taken their range yet
+            bool ready = false;
+        };
+
+        template<typename Table, typename ParseChunk>
+        static SimpleHashLoadResult run(Table& table, size_t totalBytes, size_t chunkBytes, const SimpleHashLoadOptions& options, uint64_t expectedRecords, ParseChunk& parseChunk)
+        {
+            SimpleHashLoadResult result;
+            chunkBytes = __max(chunkBytes, 1);
+            size_t chunkCount = (totalBytes + chunkBytes - 1) / chunkBytes;
+            if(chunkCount == 0)
+                return result;
+
+            size_t hardwareThreads = __max(std::thread::hardware_concurrency(), 1);
+            size_t threadCount = options.threads != 0 ? options.threads : hardwareThreads;
+            threadCount = __min(threadCount, chunkCount);
+            size_t window = threadCount*2; //how many chunks may be parsed ahead of the slowest insert
+
+            size_t partCount = 1;
+            if constexpr(is_part_loadable<Table>::value)
+                partCount = options.insertThreads != 0 ? options.insertThreads : hardwareThreads;
+
+            //a single insert thread fills the table directly. Otherwise each one fills a part that is joined at the end
+            std::vector<Table> parts;
+            if(partCount == 1)
+            {
+                if(expectedRecords != 0)
+                    table.reserve(expectedRecords);
+            }
+            else
+            {
+                parts = std::vector<Table>(partCount);
+                uint64_t perPart = expectedRecords / partCount;
+                for(Table& part : parts)
+                    part.reserve(perPart + perPart/16); //ranges are not split perfectly evenly
+            }
+
+            std::vector<Chunk<Table>> chunks(chunkCount);
+            std::atomic<size_t> nextChunk = 0;
+            std::mutex chunkMutex;
+            std::condition_variable chunkReady;
+            std::condition_variable chunkConsumed;
+            size_t consumed = 0; //chunks every insert thread is done with
+            bool failed = false;
+            std::exception_ptr error;
+
+            auto fail = [&]()
+            {
+                std::lock_guard<std::mutex> lock(chunkMutex);
+                if(!failed)
+                    error = std::current_exception();
+                failed = true;
+                chunkReady.notify_all();
+                chunkConsumed.notify_all();
+            };
+
+            auto worker = [&]()
+            {
+                try
+                {
+                    while(true)
+                    {
+                        size_t c = nextChunk++;
+                        if(c >= chunkCount)
+                            return;
+                        {
+                            std::unique_lock<std::mutex> lock(chunkMutex);
+                            chunkConsumed.wait(lock, [&](){ return c < consumed + window || failed; });
+                            if(failed)
+                                return;
+                        }
+
+                        std::vector<HashedItem<Table>> items;
+                        uint64_t skipped = 0;
+                        size_t start = c*chunkBytes;
+                        parseChunk(start, __min(start + chunkBytes, totalBytes), items, skipped);
+                        uint64_t records = items.size();
+
+                        std::vector<std::vector<HashedItem<Table>>> byPart(partCount);
+                        if(partCount == 1)
+                            byPart[0] = std::move(items);
+                        else if constexpr(is_part_loadable<Table>::value)
+                        {
+                            for(HashedItem<Table>& item : items)
+                                byPart[Table::getHashRangeIndex(item.first, partCount)].push_back(std::move(item));
+                        }
+
+                        std::lock_guard<std::mutex> lock(chunkMutex);
+                        chunks[c].parts = std::move(byPart);
+                        chunks[c].remaining = partCount;
+                        chunks[c].ready = true;
+                        result.records += records;
+                        result.skipped += skipped;
+                        chunkReady.notify_all();
+                    }
+                }
+                catch(...)
+                {
+                    fail();
+                }
+            };
+
+            //takes range r of every chunk in file order so the first record with a key is still the one kept
+            auto inserter = [&](size_t r)
+            {
+                Table& target = (partCount == 1) ? table : parts[r];
+                try
+                {
+                    for(size_t c=0; c<chunkCount; c++)
+                    {
+                        {
+                            std::unique_lock<std::mutex> lock(chunkMutex);
+                            chunkReady.wait(lock, [&](){ return chunks[c].ready || failed; });
+                            if(failed)
+                                return;
+                        }
+
+                        //only this thread touches range r of a ready chunk
+                        std::vector<HashedItem<Table>> items = std::move(chunks[c].parts[r]);
+                        for(HashedItem<Table>& item : items)
+                            target.insertHashed(item.first, std::move(item.second));
+
+                        {
+                            std::lock_guard<std::mutex> lock(chunkMutex);
+                            chunks[c].remaining--;
+                            while(consumed < chunkCount && chunks[consumed].ready && chunks[consumed].remaining == 0)
+                            {
+                                chunks[consumed].parts = std::vector<std::vector<HashedItem<Table>>>();
+                                consumed++;
+                            }
+                        }
+                        chunkConsumed.notify_all();
+                    }
+                }
+                catch(...)
+                {
+                    fail();
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for(size_t i=0; i<threadCount; i++)
+                threads.emplace_back(worker);
+            for(size_t r=1; r<partCount; r++)
+                threads.emplace_back(inserter, r);
+            inserter(0);
+
+            for(std::thread& t : threads)
+                t.join();
+            if(error)
+                std::rethrow_exception(error);
+            if constexpr(is_part_loadable<Table>::value)
+            {
+                if(partCount > 1)
+                    table.concat(parts);
+            }
+            return result;
+        }
+    };
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace smpl
+{
+    /**
+     * @brief A whole file mapped read only into memory. Unmapped when destroyed.
+     *      Uses mmap on POSIX systems and MapViewOfFile on Windows.
+     *      An empty file is allowed and maps to nothing (data() is nullptr).
+     */
+    class SimpleHashMappedFile
+    {
+    public:
+        SimpleHashMappedFile(){}
+
+        SimpleHashMappedFile(const std::string& filename)
+        {
+            open(filename);
+        }
+
+        SimpleHashMappedFile(const SimpleHashMappedFile& other) = delete;
+        SimpleHashMappedFile& operator=(const SimpleHashMappedFile& other) = delete;
+
+        SimpleHashMappedFile(SimpleHashMappedFile&& other) noexcept
+        {
+            mappedData = other.mappedData;
+            mappedSize = other.mappedSize;
+            other.mappedData = nullptr;
+            other.mappedSize = 0;
+        }
+
+        SimpleHashMappedFile& operator=(SimpleHashMappedFile&& other) noexcept
+        {
+            if(this != &other)
+            {
+                close();
+                mappedData = other.mappedData;
+                mappedSize = other.mappedSize;
+                other.mappedData = nullptr;
+                other.mappedSize = 0;
+            }
+            return *this;
+        }
+
+        ~SimpleHashMappedFile()
+        {
+            close();
+        }
+
+        /**
+         * @brief Maps the whole file replacing anything mapped before.
+         *      Throws std::runtime_error if the file can not be opened or mapped.
+         *
+         * @param filename
+         */
+        void open(const std::string& filename)
+        {
+            close();
+#ifdef _WIN32
+            HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if(file == INVALID_HANDLE_VALUE)
+                throw std::runtime_error("COULD NOT OPEN FILE");
+            LARGE_INTEGER fileSize;
+            if(!GetFileSizeEx(file, &fileSize))
+            {
+                CloseHandle(file);
+                throw std::runtime_error("COULD NOT OPEN FILE");
+            }
+            if(fileSize.QuadPart == 0)
+            {
+                CloseHandle(file);
+                return;
+            }
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if(mapping == nullptr)
+                throw std::runtime_error("COULD NOT MAP FILE");
+            void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); //the view keeps the mapping alive
+            if(data == nullptr)
+                throw std::runtime_error("COULD NOT MAP FILE");
+            mappedData = data;
+            mappedSize = (size_t)fileSize.QuadPart;
+#else
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if(fd < 0)
+                throw std::runtime_error("COULD NOT OPEN FILE");
+            struct stat fileInfo;
+            if(fstat(fd, &fileInfo) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("COULD NOT OPEN FILE");
+            }
+            if(fileInfo.st_size == 0)
+            {
+                ::close(fd);
+                return;
+            }
+            void* data = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd); //the mapping keeps the file alive
+            if(data == MAP_FAILED)
+                throw std::runtime_error("COULD NOT MAP FILE");
+            mappedData = data;
+            mappedSize = (size_t)fileInfo.st_size;
+#endif
+        }
+
+        /**
+         * @brief Unmaps the file. Any pointer into it is no longer valid.
+         *
+         */
+        void close()
+        {
+            if(mappedData != nullptr)
+            {
+#ifdef _WIN32
+                UnmapViewOfFile(mappedData);
+#else
+                munmap(mappedData, mappedSize);
+#endif
+            }
+            mappedData = nullptr;
+            mappedSize = 0;
+        }
+
+        /**
+         * @brief Hints that the file will be read from start to end once so the operating system can read ahead further.
+         *      Does nothing on Windows.
+         *
+         */
+        void adviseSequential()
+        {
+#ifndef _WIN32
+            if(mappedData != nullptr)
+                madvise(mappedData, mappedSize, MADV_SEQUENTIAL);
+#endif
+        }
+
+        const uint8_t* data() const
+        {
+            return (const uint8_t*)mappedData;
+        }
+
+        size_t size() const
+        {
+            return mappedSize;
+        }
+
+    private:
+        void* mappedData = nullptr;
+        size_t mappedSize = 0;
+    };
+}
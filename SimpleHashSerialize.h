@@ -0,0 +1,367 @@
+#pragma once
+#include "rapidhash.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace smpl
+{
+    //Snapshot layout (see SimpleHashTable::save())
+    //  SimpleHashSnapshotHeader (128 bytes. Has its own checksum)
+    //  fastHashInfo    | padded to SNAPSHOT_ALIGNMENT
+    //  redirectInfo    | padded to SNAPSHOT_ALIGNMENT
+    //  denseIndex      | padded to SNAPSHOT_ALIGNMENT
+    //  elements        | padded to SNAPSHOT_ALIGNMENT. Raw bytes if every element is trivially copyable. Otherwise written by SimpleHashSerializer
+    //  checksum of everything after the header (8 bytes)
+    //Every section starts at a multiple of SNAPSHOT_ALIGNMENT so the file can be used in place once mapped into memory.
+    inline constexpr uint32_t SNAPSHOT_VERSION = 1;
+    inline constexpr size_t SNAPSHOT_ALIGNMENT = 64;
+
+    inline constexpr uint32_t SNAPSHOT_FLAG_MULTI = 0x1;
+    inline constexpr uint32_t SNAPSHOT_FLAG_BIG = 0x2;
+    inline constexpr uint32_t SNAPSHOT_FLAG_SET = 0x4;
+    inline constexpr uint32_t SNAPSHOT_FLAG_RAW_ELEMENTS = 0x8;
+
+    struct SimpleHashSnapshotHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t elementSize;
+        uint32_t redirectSize;
+        uint64_t bucketCount;
+        uint64_t elementCount; //size of the internal array. Not the same as totalElements for a multimap
+        uint64_t totalElements;
+        uint64_t denseMin;
+        uint64_t denseCount;
+        uint8_t smallHashInfo[16];
+        uint64_t headerChecksum;
+        uint8_t reserved[32];
+    };
+    static_assert(sizeof(SimpleHashSnapshotHeader) == 128, "Snapshot header must stay 128 bytes");
+
+    inline constexpr char SNAPSHOT_MAGIC[8] = {'S', 'M', 'P', 'L', 'H', 'A', 'S', 'H'};
+
+    //true if the type can be written as its raw bytes. std::pair of those types is allowed too since its members are laid out in order.
+    template<typename T>
+    struct is_raw_serializable : std::is_trivially_copyable<T> {};
+
+    template<typename A, typename B>
+    struct is_raw_serializable<std::pair<A, B>> : std::bool_constant<is_raw_serializable<A>::value && is_raw_serializable<B>::value> {};
+
+    template<typename T>
+    constexpr bool is_raw_serializable_v = is_raw_serializable<T>::value;
+
+    //builds a raw serializable type from the bytes it was written as without needing a default constructor.
+    //  std::pair is not trivially copyable itself so it is built from its members.
+    template<typename T>
+    struct SimpleHashRawElement
+    {
+        static T fromBytes(const unsigned char* data)
+        {
+            struct Bytes { unsigned char data[sizeof(T)]; } bytes;
+            std::memcpy(bytes.data, data, sizeof(T));
+            return std::bit_cast<T>(bytes);
+        }
+    };
+
+    template<typename A, typename B>
+    struct SimpleHashRawElement<std::pair<A, B>>
+    {
+        using PairType = std::pair<A, B>;
+
+        static PairType fromBytes(const unsigned char* data)
+        {
+            return PairType(SimpleHashRawElement<A>::fromBytes(data + offsetof(PairType, first)),
+                SimpleHashRawElement<B>::fromBytes(data + offsetof(PairType, second)));
+        }
+    };
+
+    /**
+     * @brief Checksum over a stream of bytes. The result does not depend on how the bytes are split between calls to update().
+     *      Folds the rapidhash of every CHUNK_SIZE bytes.
+     */
+    class SimpleHashChecksum
+    {
+    public:
+        void update(const void* data, size_t size)
+        {
+            if(size == 0)
+                return;
+            const uint8_t* bytes = (const uint8_t*)data;
+            if(bufferSize > 0)
+            {
+                size_t amount = (size < CHUNK_SIZE-bufferSize) ? size : CHUNK_SIZE-bufferSize;
+                std::memcpy(buffer+bufferSize, bytes, amount);
+                bufferSize += amount;
+                bytes += amount;
+                size -= amount;
+                if(bufferSize == CHUNK_SIZE)
+                {
+                    fold(buffer, CHUNK_SIZE);
+                    bufferSize = 0;
+                }
+            }
+            while(size >= CHUNK_SIZE)
+            {
+                fold(bytes, CHUNK_SIZE);
+                bytes += CHUNK_SIZE;
+                size -= CHUNK_SIZE;
+            }
+            if(size > 0)
+            {
+                std::memcpy(buffer, bytes, size);
+                bufferSize = size;
+            }
+        }
+
+        uint64_t finish()
+        {
+            if(bufferSize > 0)
+                fold(buffer, bufferSize);
+            bufferSize = 0;
+            return state;
+        }
+
+    private:
+        static const size_t CHUNK_SIZE = 4096;
+
+        void fold(const void* data, size_t size)
+        {
+            state = rapid_mix(state ^ rapidhash(data, size), UINT64_C(0x9E3779B97F4A7C15));
+        }
+
+        uint8_t buffer[CHUNK_SIZE];
+        size_t bufferSize = 0;
+        uint64_t state = 0;
+    };
+
+    /**
+     * @brief Writes a snapshot to a stream keeping track of the offset (for alignment) and the checksum.
+     *
+     */
+    class SimpleHashSnapshotWriter
+    {
+    public:
+        SimpleHashSnapshotWriter(std::ostream& out) : out(out) {}
+
+        void writeHeader(SimpleHashSnapshotHeader header)
+        {
+            std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+            header.version = SNAPSHOT_VERSION;
+            header.headerChecksum = 0;
+            header.headerChecksum = rapidhash(&header, sizeof(header));
+            out.write((const char*)&header, sizeof(header));
+            offset += sizeof(header);
+        }
+
+        void write(const void* data, size_t size)
+        {
+            out.write((const char*)data, size);
+            checksum.update(data, size);
+            offset += size;
+        }
+
+        template<typename T>
+        void writeRaw(const T& value)
+        {
+            write(&value, sizeof(T));
+        }
+
+        //writes zeros until the offset is a multiple of alignment
+        void pad(size_t alignment = SNAPSHOT_ALIGNMENT)
+        {
+            static const uint8_t zeros[SNAPSHOT_ALIGNMENT] = {};
+            size_t amount = (alignment - (offset % alignment)) % alignment;
+            write(zeros, amount);
+        }
+
+        void finish()
+        {
+            uint64_t result = checksum.finish();
+            out.write((const char*)&result, sizeof(result));
+            out.flush();
+            if(!out)
+                throw std::runtime_error("SNAPSHOT WRITE FAILED");
+        }
+
+    private:
+        std::ostream& out;
+        SimpleHashChecksum checksum;
+        uint64_t offset = 0;
+    };
+
+    /**
+     * @brief Reads a snapshot from a stream. Throws if the stream ends early or a checksum does not match.
+     *
+     */
+    class SimpleHashSnapshotReader
+    {
+    public:
+        SimpleHashSnapshotReader(std::istream& in) : in(in) {}
+
+        SimpleHashSnapshotHeader readHeader()
+        {
+            SimpleHashSnapshotHeader header;
+            in.read((char*)&header, sizeof(header));
+            if(!in)
+                throw std::runtime_error("SNAPSHOT TRUNCATED");
+            offset += sizeof(header);
+
+            uint64_t expected = header.headerChecksum;
+            header.headerChecksum = 0;
+            if(std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || rapidhash(&header, sizeof(header)) != expected)
+                throw std::runtime_error("INVALID SNAPSHOT HEADER");
+            if(header.version != SNAPSHOT_VERSION)
+                throw std::runtime_error("UNSUPPORTED SNAPSHOT VERSION");
+            header.headerChecksum = expected;
+            return header;
+        }
+
+        void read(void* data, size_t size)
+        {
+            in.read((char*)data, size);
+            if(!in)
+                throw std::runtime_error("SNAPSHOT TRUNCATED");
+            checksum.update(data, size);
+            offset += size;
+        }
+
+        template<typename T>
+        void readRaw(T& value)
+        {
+            read(&value, sizeof(T));
+        }
+
+        /**
+         * @brief Throws std::runtime_error if the stream has fewer than size bytes left. Use before allocating for a size read from the data
+         *      so a damaged count can not cause a huge allocation.
+         *      Returns false without checking if the length of the stream can not be found (like a pipe).
+         *
+         * @param size
+         * @return bool
+         */
+        bool requireRemaining(uint64_t size)
+        {
+            std::istream::pos_type position = in.tellg();
+            if(position == std::istream::pos_type(-1))
+                return false;
+            in.seekg(0, std::ios::end);
+            std::istream::pos_type end = in.tellg();
+            in.seekg(position);
+            if(end == std::istream::pos_type(-1) || !in)
+            {
+                in.clear();
+                return false;
+            }
+            if((uint64_t)(end - position) < size)
+                throw std::runtime_error("SNAPSHOT TRUNCATED");
+            return true;
+        }
+
+        void skipPadding(size_t alignment = SNAPSHOT_ALIGNMENT)
+        {
+            uint8_t zeros[SNAPSHOT_ALIGNMENT];
+            size_t amount = (alignment - (offset % alignment)) % alignment;
+            read(zeros, amount);
+        }
+
+        void finish()
+        {
+            uint64_t expected = 0;
+            in.read((char*)&expected, sizeof(expected));
+            if(!in)
+                throw std::runtime_error("SNAPSHOT TRUNCATED");
+            if(checksum.finish() != expected)
+                throw std::runtime_error("SNAPSHOT CHECKSUM MISMATCH");
+        }
+
+    private:
+        std::istream& in;
+        SimpleHashChecksum checksum;
+        uint64_t offset = 0;
+    };
+
+    /**
+     * @brief Customization point for writing keys and values that can't be written as raw bytes.
+     *      Specialize this for your own types with:
+     *          static void write(SimpleHashSnapshotWriter& writer, const T& value)
+     *          static T read(SimpleHashSnapshotReader& reader)
+     *      Trivially copyable types, std::basic_string, and std::pair are already handled.
+     *
+     * @tparam T
+     */
+    template<typename T, typename = void>
+    struct SimpleHashSerializer
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Specialize smpl::SimpleHashSerializer for types that are not trivially copyable");
+
+        static void write(SimpleHashSnapshotWriter& writer, const T& value)
+        {
+            writer.writeRaw(value);
+        }
+
+        static T read(SimpleHashSnapshotReader& reader)
+        {
+            struct Bytes { unsigned char data[sizeof(T)]; } bytes; //no default constructor needed
+            reader.read(bytes.data, sizeof(T));
+            return std::bit_cast<T>(bytes);
+        }
+    };
+
+    //length prefixed blob
+    template<typename C, typename Traits, typename Alloc>
+    struct SimpleHashSerializer<std::basic_string<C, Traits, Alloc>>
+    {
+        static void write(SimpleHashSnapshotWriter& writer, const std::basic_string<C, Traits, Alloc>& value)
+        {
+            writer.writeRaw((uint64_t)value.size());
+            writer.write(value.data(), value.size()*sizeof(C));
+        }
+
+        static std::basic_string<C, Traits, Alloc> read(SimpleHashSnapshotReader& reader)
+        {
+            uint64_t length = 0;
+            reader.readRaw(length);
+            //grows in chunks so a corrupted length fails as truncated instead of allocating something huge
+            std::basic_string<C, Traits, Alloc> result;
+            while(result.size() < length)
+            {
+                size_t oldSize = result.size();
+                size_t amount = (length - oldSize < MAX_CHUNK) ? length - oldSize : MAX_CHUNK;
+                result.resize(oldSize + amount);
+                reader.read(result.data() + oldSize, amount*sizeof(C));
+            }
+            return result;
+        }
+
+    private:
+        static const size_t MAX_CHUNK = 1<<16;
+    };
+
+    template<typename A, typename B>
+    struct SimpleHashSerializer<std::pair<A, B>>
+    {
+        static void write(SimpleHashSnapshotWriter& writer, const std::pair<A, B>& value)
+        {
+            SimpleHashSerializer<A>::write(writer, value.first);
+            SimpleHashSerializer<B>::write(writer, value.second);
+        }
+
+        static std::pair<A, B> read(SimpleHashSnapshotReader& reader)
+        {
+            A first = SimpleHashSerializer<A>::read(reader);
+            B second = SimpleHashSerializer<B>::read(reader);
+            return std::pair<A, B>(std::move(first), std::move(second));
+        }
+    };
+}
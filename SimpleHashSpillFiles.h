@@ -0,0 +1,126 @@
+#pragma once
+#include "SimpleHashSerialize.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace smpl
+{
+    /**
+     * @brief The files partitions are written to when a structure goes over its memory budget. There is one file per partition index,
+     *      created the first time it is asked for and removed when this object is destroyed.
+     *      File names start with a prefix unique to this object so several instances can share a spill directory.
+     */
+    class SimpleHashSpillFiles
+    {
+    public:
+        SimpleHashSpillFiles(){}
+
+        SimpleHashSpillFiles(const SimpleHashSpillFiles& other) = delete;
+        SimpleHashSpillFiles& operator=(const SimpleHashSpillFiles& other) = delete;
+
+        /**
+         * @brief Removes every file that was created.
+         *
+         */
+        ~SimpleHashSpillFiles()
+        {
+            for(size_t i=0; i<files.size(); i++)
+            {
+                if(files[i] != nullptr)
+                {
+                    files[i].reset();
+                    std::error_code error;
+                    std::filesystem::remove(getFileName(i), error);
+                }
+            }
+        }
+
+        /**
+         * @brief Sets where the files are created. Must be called before getFile().
+         *      Throws std::runtime_error if the directory does not exist and can not be created.
+         *
+         * @param directory
+         * @param name
+         *      Start of the file names. Only used to tell apart the files of different structures.
+         */
+        void open(const std::string& directory, const std::string& name)
+        {
+            static std::atomic<uint64_t> instanceCounter = 0;
+            this->directory = directory;
+            filePrefix = name + "_" + std::to_string(instanceCounter++) + "_" + std::to_string((uintptr_t)this) + "_";
+
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            if(!std::filesystem::is_directory(directory))
+                throw std::runtime_error("COULD NOT CREATE SPILL DIRECTORY");
+        }
+
+        /**
+         * @brief Gets whether the file for index was created.
+         *
+         * @param index
+         * @return bool
+         */
+        bool exists(size_t index)
+        {
+            return index < files.size() && files[index] != nullptr;
+        }
+
+        /**
+         * @brief Gets the file for index creating an empty one the first time.
+         *      Throws std::runtime_error if it can not be created.
+         *
+         * @param index
+         * @return std::fstream&
+         */
+        std::fstream& getFile(size_t index)
+        {
+            if(index >= files.size())
+                files.resize(index+1);
+            if(files[index] == nullptr)
+            {
+                files[index] = std::make_unique<std::fstream>(getFileName(index), std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+                if(!*files[index])
+                    throw std::runtime_error("COULD NOT OPEN FILE");
+            }
+            return *files[index];
+        }
+
+        /**
+         * @brief Writes item as raw bytes when trivially copyable and through SimpleHashSerializer otherwise.
+         *      SimpleHashSerializer<T>::read() reads it back either way.
+         *
+         * @tparam T
+         * @param out
+         * @param item
+         */
+        template<typename T>
+        static void writeItem(std::ostream& out, const T& item)
+        {
+            if constexpr(std::is_trivially_copyable_v<T>)
+                out.write((const char*)&item, sizeof(T));
+            else
+            {
+                SimpleHashSnapshotWriter writer(out);
+                SimpleHashSerializer<T>::write(writer, item);
+            }
+        }
+
+    private:
+        std::string getFileName(size_t index)
+        {
+            return (std::filesystem::path(directory) / (filePrefix + std::to_string(index) + ".bin")).string();
+        }
+
+        std::vector<std::unique_ptr<std::fstream>> files;
+        std::string directory;
+        std::string filePrefix;
+    };
+}
@@ -1,20 +1,34 @@
 #pragma once
 #include "ImportantInclude.h"
+#include "SimpleHashTableReclaimer.h"
+#include "SimpleHashTableRecycler.h"
+#include "SimpleHashSerialize.h"
+#include "SimpleHashBloomFilter.h"
+#include <array>
 #include <climits>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <functional>
 #include <iterator>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 #include <initializer_list>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SMPL_USE_SSE2
+#endif
 
 #ifndef LIKELY
 #define LIKELY(x)      __builtin_expect(!!(x), 1)
@@ -41,6 +55,43 @@ namespace smpl
 
     template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
     using SimpleHashMultiSet = SimpleHashTable<Key, void, true, HashFunc, KeyEqual, BIG>;
+
+    /**
+     * @brief Runs func(thread) for every thread in [0, threadCount). Thread 0 is the calling thread.
+     *      Waits for every thread then rethrows the first exception any of them threw.
+     *
+     * @tparam F
+     * @param threadCount
+     * @param func
+     */
+    template<typename F>
+    void runSimpleHashThreads(size_t threadCount, F&& func)
+    {
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        auto guarded = [&](size_t thread)
+        {
+            try
+            {
+                func(thread);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if(!error)
+                    error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for(size_t t=1; t<threadCount; t++)
+            threads.emplace_back(guarded, t);
+        guarded(0);
+        for(std::thread& t : threads)
+            t.join();
+        if(error)
+            std::rethrow_exception(error);
+    }
 	
     template<typename Key, typename Value, bool MULTI, typename HashFunc, typename KeyEqual, bool BIG>
 	struct SimpleHashTableIterator
@@ -68,7 +119,7 @@ namespace smpl
 			{
 				this->rehashCounter = ptr->rehashCounter;
 				
-				if(index < ptr->size())
+				if(index < ptr->arr.size())
 					listIterator = ptr->arr[index].begin();
 			}
 		}
@@ -97,6 +148,17 @@ namespace smpl
 
 		~SimpleHashTableIterator(){}
 
+        /**
+         * @brief Gets the index of the element in the table's internal array. Indices stay the same until something is erased.
+         *      Erasing moves the last element of the array into the erased element's index.
+         * 
+         * @return uint64_t 
+         */
+        uint64_t getIndex() const
+        {
+            return index;
+        }
+
 		template<bool M = MULTI>
 		typename std::enable_if_t<M, SimpleHashTableIterator&>
 		operator++()
@@ -213,11 +275,13 @@ namespace smpl
     class SimpleHashTable
     {
     public:
+        using KeyType = Key;
         using RedirectType = std::conditional_t<BIG, uint64_t, uint32_t>;
         using HashRedirectPair = std::pair<RedirectType, RedirectType>;
         using KeyValueType = std::conditional_t<std::is_same_v<void, Value>, Key, std::pair<Key, Value>>;
 		using KVStorageType = std::conditional_t<MULTI, std::list<KeyValueType>, KeyValueType>;
 		using Iterator = SimpleHashTableIterator<Key, Value, MULTI, HashFunc, KeyEqual, BIG>;
+		using Recycler = SimpleHashTableRecycler<HashRedirectPair, KVStorageType>;
 
 
         /**
@@ -225,6 +289,8 @@ namespace smpl
          *      Note that whether it is a map or set depends on what template parameters are set.
          *          To create a set, Set the Value template parameter to void
          *      The table is completely empty with no memory allocated yet so everything is in an invalid state.
+         *      No buckets are allocated until more than SMALL_TABLE_SIZE elements are added.
+         *          Until then, elements are found by a linear search over fingerprints stored in the table itself.
          */
         SimpleHashTable(){}
 
@@ -233,6 +299,7 @@ namespace smpl
          *      Initializes the hash data table to an initial size of buckets.
          *      Useful to avoid rehashing (or multiple rehashing) when you have a known minimum/maximum size of elements to go into the table.
          *          Note that you may not have less than 1024 buckets though you may request it.
+         *          If initSize is no more than SMALL_TABLE_SIZE, no buckets are allocated and the table starts in small mode.
          *
          *      Note that whether it is a map or set depends on what template parameters are set.
          *          To create a set, Set the Value template parameter to void
@@ -245,11 +312,15 @@ namespace smpl
          */
         SimpleHashTable(size_t initSize)
         {
+            if(initSize <= SMALL_TABLE_SIZE)
+            {
+                arr.reserve(initSize);
+                return;
+            }
             if(initSize < 1024)
                 initSize = 1024;
 
-            fastHashInfo = std::vector<uint8_t>(initSize);
-            redirectInfo = std::vector<HashRedirectPair>(initSize);
+            acquireBuckets(initSize, false, fastHashInfo, redirectInfo);
         }
 
         SimpleHashTable(const std::initializer_list<KeyValueType>& defaultValues)
@@ -262,10 +333,16 @@ namespace smpl
 
         /**
          * @brief Destroy the Hash Table.
+         *      If recycling is enabled for this thread, the buckets and the element array are kept for the next table.
+         *      If deferred destruction is enabled, the elements are destroyed later by the SimpleHashTableReclaimer instead.
          * 
          */
         ~SimpleHashTable()
         {
+            if(deferredDestruction)
+                clear_async();
+            releaseBuckets(fastHashInfo, redirectInfo);
+            releaseElements(arr);
         }
         
         /**
@@ -273,28 +350,38 @@ namespace smpl
          * 
          * @param other 
          */
-        SimpleHashTable(SimpleHashTable<Key, Value, MULTI>& other)
+        SimpleHashTable(const SimpleHashTable& other)
         {
             arr = other.arr;
             extraKeyStorage = other.extraKeyStorage;
             fastHashInfo = other.fastHashInfo;
             redirectInfo = other.redirectInfo;
+            smallHashInfo = other.smallHashInfo;
+            denseIndex = other.denseIndex;
+            denseMin = other.denseMin;
 			totalElements = other.totalElements;
 			rehashCounter = other.rehashCounter;
+            hasher = other.hasher;
+            keyEqualFunc = other.keyEqualFunc;
         }
         /**
          * @brief Copy Assign a new Hash Table object
          * 
          * @param other 
          */
-        void operator=(SimpleHashTable<Key, Value, MULTI>& other)
+        void operator=(const SimpleHashTable& other)
         {
             arr = other.arr;
             extraKeyStorage = other.extraKeyStorage;
             fastHashInfo = other.fastHashInfo;
             redirectInfo = other.redirectInfo;
+            smallHashInfo = other.smallHashInfo;
+            denseIndex = other.denseIndex;
+            denseMin = other.denseMin;
 			totalElements = other.totalElements;
 			rehashCounter = other.rehashCounter;
+            hasher = other.hasher;
+            keyEqualFunc = other.keyEqualFunc;
         }
 
         /**
@@ -303,14 +390,19 @@ namespace smpl
          * 
          * @param other 
          */
-        SimpleHashTable(SimpleHashTable<Key, Value, MULTI>&& other) noexcept
+        SimpleHashTable(SimpleHashTable&& other) noexcept
         {
             arr = std::move(other.arr);
             extraKeyStorage = std::move(other.extraKeyStorage);
             fastHashInfo = std::move(other.fastHashInfo);
             redirectInfo = std::move(other.redirectInfo);
+            smallHashInfo = other.smallHashInfo;
+            denseIndex = std::move(other.denseIndex);
+            denseMin = other.denseMin;
 			totalElements = std::move(other.totalElements);
 			rehashCounter = std::move(other.rehashCounter);
+            hasher = std::move(other.hasher);
+            keyEqualFunc = std::move(other.keyEqualFunc);
         }
         
         /**
@@ -319,14 +411,19 @@ namespace smpl
          * 
          * @param other 
          */
-        void operator=(SimpleHashTable<Key, Value, MULTI>&& other) noexcept
+        void operator=(SimpleHashTable&& other) noexcept
         {
             arr = std::move(other.arr);
             extraKeyStorage = std::move(other.extraKeyStorage);
             fastHashInfo = std::move(other.fastHashInfo);
             redirectInfo = std::move(other.redirectInfo);
+            smallHashInfo = other.smallHashInfo;
+            denseIndex = std::move(other.denseIndex);
+            denseMin = other.denseMin;
 			totalElements = std::move(other.totalElements);
 			rehashCounter = std::move(other.rehashCounter);
+            hasher = std::move(other.hasher);
+            keyEqualFunc = std::move(other.keyEqualFunc);
         }
 
         /**
@@ -335,8 +432,8 @@ namespace smpl
          */
         void clear()
         {
-            fastHashInfo.clear();
-            redirectInfo.clear();
+            releaseBuckets(fastHashInfo, redirectInfo);
+            denseIndex.clear();
             arr.clear();
 			extraKeyStorage.clear();
 			totalElements = 0;
@@ -353,12 +450,55 @@ namespace smpl
         {
 			std::memset((void*)fastHashInfo.data(), 0, fastHashInfo.size());
 			std::memset((void*)redirectInfo.data(), 0, redirectInfo.size()*sizeof(HashRedirectPair));
+			std::memset((void*)denseIndex.data(), 0, denseIndex.size()*sizeof(RedirectType));
             arr.clear();
 			extraKeyStorage.clear();
 			totalElements = 0;
 			rehashCounter++;
         }
 
+        /**
+         * @brief Clears the hash table in O(1) by handing all of its storage to the SimpleHashTableReclaimer.
+         *      The elements are destroyed later, either on the reclaimer's background thread or in bounded chunks
+         *      through SimpleHashTableReclaimer::get().reclaim(budget).
+         *      Useful when destroying every element (and every list in a multimap) would take too long on the current thread.
+         *      If the reclaimer was already destroyed (a static table at exit), everything is freed on the calling thread instead.
+         * 
+         */
+        void clear_async()
+        {
+            SimpleHashTableReclaimer* reclaimer = SimpleHashTableReclaimer::getIfAlive();
+            if(reclaimer != nullptr)
+            {
+                reclaimer->retire(arr);
+                reclaimer->retire(extraKeyStorage);
+                reclaimer->retire(fastHashInfo);
+                reclaimer->retire(redirectInfo);
+                reclaimer->retire(denseIndex);
+            }
+            else
+            {
+                arr = std::vector<KVStorageType>();
+                extraKeyStorage = std::vector<Key>();
+                fastHashInfo = std::vector<uint8_t>();
+                redirectInfo = std::vector<HashRedirectPair>();
+                denseIndex = std::vector<RedirectType>();
+            }
+            totalElements = 0;
+            rehashCounter++;
+        }
+
+        /**
+         * @brief Sets whether the destructor should hand the storage to the SimpleHashTableReclaimer like clear_async()
+         *      instead of destroying every element itself. Disabled by default.
+         * 
+         * @param deferred 
+         */
+        void setDeferredDestruction(bool deferred)
+        {
+            deferredDestruction = deferred;
+        }
+
         //enable if map meaning that Value is not void.
 
         /**
@@ -371,7 +511,7 @@ namespace smpl
          * @return Value& 
          */
         template<typename Q = Value, std::enable_if_t<!std::is_same_v<void, Q>, bool> = true>
-        Value& operator[](const Key& k)
+        Q& operator[](const Key& k)
         {
             return try_emplace(k)->second;
         }
@@ -393,7 +533,7 @@ namespace smpl
          */
         template<typename P, typename Q = Value, typename H = HashFunc, typename KE = KeyEqual,
         std::enable_if_t<!std::is_same_v<void, Q> && both_transparent_v<H, KE>, bool> = true>
-        Value& operator[](P&& k)
+        Q& operator[](P&& k)
         {
             return try_emplace(std::forward<P>(k))->second;
         }
@@ -420,7 +560,7 @@ namespace smpl
          */
         auto insert(const KeyValueType& v)
         {
-            return emplace(v);
+            return emplace(KeyValueType(v));
         }
 
         /**
@@ -465,50 +605,89 @@ namespace smpl
          */
         auto emplace(KeyValueType&& v)
         {
-            if(fastHashInfo.size() == 0)
-            {
-                fastHashInfo = std::vector<uint8_t>(1024);
-                redirectInfo = std::vector<HashRedirectPair>(1024);
-            }
-            
-            //extra check needed if and only if its possible to overflow
-            //does nothing if BIG is enabled
-            checkIfOverflowPossible();
-			
-            const Key& key = getKey(v);
-            uint64_t actualHash = hasher(key);
+            return emplaceHashed<false>(0, std::move(v));
+        }
 
-            uint8_t partialHash = extractPartialHash(actualHash); //must replace top bit so its considered valid
-            RedirectType extraHash = extractPartialHashEx(actualHash);
-            uint64_t intendedLocation = actualHash % fastHashInfo.size();
-            while(!getLocationEmpty(intendedLocation))
-            {
-                if(checkForDuplicate(intendedLocation, partialHash, extraHash, key))
-                {
-					return appendMultimap(intendedLocation, std::forward<KeyValueType>(v)); //will handle the pop_back()
-                }
+        /**
+         * @brief Same as insert() but uses a hash that was already computed. Useful when hashing happens somewhere else
+         *      like on another thread while parsing (see SimpleHashLoader).
+         *      The hash must be exactly what HashFunc returns for the key. It is stored and used for every later rehash
+         *          so a different hash would make the element impossible to find.
+         * 
+         * @param hash 
+         * @param v 
+         * @return auto 
+         */
+        auto insertHashed(uint64_t hash, KeyValueType&& v)
+        {
+            return emplaceHashed<true>(hash, std::move(v));
+        }
 
-                intendedLocation = (intendedLocation+1) % fastHashInfo.size();
-            }
+        /**
+         * @brief Hashes a key the same way the table does. Pass the result to insertHashed().
+         *      Only reads the hash function so it can be called from other threads while the table is being changed.
+         * 
+         * @param key 
+         * @return uint64_t 
+         */
+        uint64_t hashKey(const Key& key)
+        {
+            return hasher(key);
+        }
+
+        /**
+         * @brief Makes room for at least count elements so inserting them does not need to rehash or reallocate the internal array.
+         *      Useful before a bulk load when the number of elements is known or can be estimated.
+         *      Does nothing to the buckets for small tables or while integer keys are dense.
+         * 
+         * @param count 
+         */
+        void reserve(uint64_t count)
+        {
+            arr.reserve(count);
+            if(count <= SMALL_TABLE_SIZE || isDense())
+                return;
             
-			attemptToAdd(std::forward<KeyValueType>(v));
-            fastHashInfo[intendedLocation] = partialHash;
-            redirectInfo[intendedLocation] = {actualHash, arr.size()-1};
+            size_t newSize = 1024;
+            while(count >= newSize*MaxLoadBalance)
+                newSize *= 2;
+            if(newSize <= fastHashInfo.size())
+                return;
+            if(isSmall())
+                rebuildBuckets(newSize);
+            else
+                resizeBuckets(newSize);
+        }
 
-			Iterator returnIt = Iterator(this, arr.size()-1, false);
-			returnIt.bucketIndex = intendedLocation;
-			
-            float currentLoadBalance = (float)arr.size() / (float)fastHashInfo.size();
-            if(currentLoadBalance > MaxLoadBalance)
+        /**
+         * @brief Same as reserve() but for integer keys where the smallest and largest key about to be inserted are known
+         *      (like after a SimpleHashHyperLogLog pass over them).
+         *      A table only checks for dense mode when it rehashes so one reserved for all of its keys would never switch.
+         *      If the table is empty and count keys fill enough of [minKey, maxKey], it starts in dense mode instead.
+         * 
+         * @param count 
+         * @param minKey 
+         * @param maxKey 
+         */
+        template<typename Q = Key, std::enable_if_t<std::is_integral_v<Q>, bool> = true>
+        void reserve(uint64_t count, const Key& minKey, const Key& maxKey)
+        {
+            if constexpr(DENSE_ALLOWED)
             {
-				//re-balance
-                rebalance();
+                uint64_t range = (uint64_t)maxKey - (uint64_t)minKey + 1;
+                if(arr.size() == 0 && count > SMALL_TABLE_SIZE && minKey <= maxKey && range != 0 && range <= count*DENSE_RANGE_FACTOR)
+                {
+                    arr.reserve(count);
+                    releaseBuckets(fastHashInfo, redirectInfo);
+                    denseMin = (uint64_t)minKey;
+                    denseIndex = std::vector<RedirectType>(range);
+                    rehashCounter++;
+                    return;
+                }
             }
-			
-			totalElements++;
-            return returnIt; //Bucket index may be invalid if a rehash occured right before this returns.
+            reserve(count);
         }
-        
+
         /**
          * @brief Attempts to find an element by P comparing it to it an element's Key.
          *      If it exists, returns an iterator to it. Otherwise returns an iterator to the end of the hash table.
@@ -539,6 +718,76 @@ namespace smpl
         {
             return search(k);
         }
+
+        /**
+         * @brief Same as find() but uses a hash that was already computed with hashKey().
+         *      Useful when the same key is looked up in several tables or the hash was computed ahead of time like in a batch.
+         * 
+         * @param hash 
+         * @param k 
+         * @return auto 
+         */
+        auto findHashed(uint64_t hash, const Key& k)
+        {
+            return searchHashed<true>(hash, k);
+        }
+
+        /**
+         * @brief Starts loading the bucket a lookup for the hash begins at into the cache without waiting for it.
+         *      Prefetching a batch of hashes before calling findHashed() on them lets the cache misses overlap instead of
+         *      happening one at a time. Does nothing in small or dense mode.
+         * 
+         * @param hash 
+         */
+        void prefetch(uint64_t hash)
+        {
+            if(fastHashInfo.size() == 0)
+                return;
+            uint64_t location = hash % fastHashInfo.size();
+            __builtin_prefetch(&fastHashInfo[location]);
+            __builtin_prefetch(&redirectInfo[location]);
+        }
+
+        /**
+         * @brief Builds a blocked Bloom filter of every key in the table from the hashes stored in the buckets. No key is read or rehashed
+         *      unless the table is in small or dense mode (which do not store hashes).
+         *      Probe it with the same hash function as the table (like filter.mayContainHash(table.hashKey(key))) to skip lookups
+         *      that would miss, for example before asking a remote shard. It can be sent elsewhere with SimpleHashBloomFilter::save().
+         * 
+         * @param bitsPerKey 
+         *      10 gives about a 2% false positive rate and 16 about 0.1%.
+         * @param capacity 
+         *      Number of keys to size the filter for. 0 uses the current size. Use more if the filter will be tracked (see setTrackedFilter()).
+         * @return SimpleHashBloomFilter 
+         */
+        SimpleHashBloomFilter make_filter(double bitsPerKey = 10, uint64_t capacity = 0)
+        {
+            SimpleHashBloomFilter filter(__max(capacity != 0 ? capacity : arr.size(), 1), bitsPerKey, sizeof(RedirectType)*8);
+            walkStoredHashes(0, getStoredHashWalkSize(), [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                filter.addHash(storedHash);
+            });
+            return filter;
+        }
+
+        /**
+         * @brief Keeps a filter from make_filter() up to date by adding the hash of every new key inserted after this.
+         *      Erased keys stay in the filter (a Bloom filter can not remove them) so it only ever has extra false positives.
+         *          Build a new one after many erases. Keys added by load() are not tracked.
+         *      Costs a few extra instructions per insert. Small and dense mode have to hash the key to track it.
+         *      The filter is not copied or moved with the table. Pass nullptr to stop tracking.
+         * 
+         * @param filter 
+         */
+        void setTrackedFilter(std::shared_ptr<SimpleHashBloomFilter> filter)
+        {
+            trackedFilter = std::move(filter);
+        }
+
+        std::shared_ptr<SimpleHashBloomFilter> getTrackedFilter()
+        {
+            return trackedFilter;
+        }
         
 
         /**
@@ -621,12 +870,192 @@ namespace smpl
 		{
 			return remove(it, true);
 		}
+
+        /**
+         * @brief Holds an element removed by extract() along with its fingerprint and stored hash so it can be inserted into
+         *      another table of the same type without hashing the key again. Empty if nothing was extracted.
+         *      The key can not be changed since the hash would no longer match.
+         * 
+         */
+        class NodeHandle
+        {
+        public:
+            NodeHandle(){}
+
+            bool empty() const
+            {
+                return !element.has_value();
+            }
+            explicit operator bool() const
+            {
+                return element.has_value();
+            }
+
+            const Key& key() const
+            {
+                if constexpr(std::is_same_v<Key, KeyValueType>)
+                    return *element;
+                else
+                    return element->first;
+            }
+
+            template<typename Q = Value, std::enable_if_t<!std::is_same_v<void, Q>, bool> = true>
+            Q& mapped()
+            {
+                return element->second;
+            }
+
+        private:
+            friend class SimpleHashTable;
+            std::optional<KeyValueType> element;
+            uint8_t partialHash = 0;
+            RedirectType storedHash = 0;
+        };
+
+        /**
+         * @brief Removes the element with the key and returns it in a NodeHandle. The NodeHandle is empty if the key does not exist.
+         *      The element is moved out, not copied. Iterators are invalidated the same way erase() invalidates them.
+         *      Not available for multimaps.
+         * 
+         * @param k 
+         * @return NodeHandle 
+         */
+        NodeHandle extract(const Key& k)
+        {
+            return extractAt(find(k));
+        }
+
+        /**
+         * @brief Same as extract(const Key&) but for an iterator from this table. Returns an empty NodeHandle for end().
+         * 
+         * @param it 
+         * @return NodeHandle 
+         */
+        NodeHandle extract(const Iterator& it)
+        {
+            return extractAt(it);
+        }
+
+        /**
+         * @brief Inserts an extracted element using the hash stored in the NodeHandle instead of hashing the key.
+         *      The NodeHandle must come from a table of the same type (same HashFunc and seed).
+         *      If the key already exists nothing is inserted and the NodeHandle keeps the element. Otherwise the NodeHandle is emptied.
+         *      Returns an iterator to the inserted or existing element or end() if the NodeHandle is empty.
+         * 
+         * @param node 
+         * @return Iterator 
+         */
+        Iterator insert(NodeHandle&& node)
+        {
+            static_assert(!MULTI, "Node handles are not available for multimaps");
+            if(node.empty())
+                return end();
+            size_t sizeBefore = totalElements;
+            Iterator it = insertStored(node.partialHash, node.storedHash, std::move(*node.element));
+            if(totalElements != sizeBefore)
+                node.element.reset();
+            return it;
+        }
+
+        /**
+         * @brief Moves every element of other whose key is not in this table into this table. Elements with keys that already
+         *      exist here stay in other (like std::unordered_map::merge()).
+         *      Elements are moved, never copied, and the hashes stored in other are reused so nothing is rehashed unless a table
+         *      is in small or dense mode. Not available for multimaps.
+         * 
+         * @param other 
+         */
+        void splice(SimpleHashTable& other)
+        {
+            static_assert(!MULTI, "Splicing is not available for multimaps");
+            if(&other == this || other.arr.size() == 0)
+                return;
+
+            std::vector<uint8_t> keep(other.arr.size());
+            other.walkStoredHashes(0, other.getStoredHashWalkSize(), [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                size_t sizeBefore = totalElements;
+                insertStored(partialHash, storedHash, std::move(other.arr[index]));
+                keep[index] = (totalElements == sizeBefore);
+            });
+            other.removeUnkept(keep);
+        }
+
+        /**
+         * @brief Moves every element into n new tables by hash range and leaves this table empty.
+         *      Part i gets the keys where getHashRangeIndex(hashKey(key), n) == i so new keys can be routed to the same part.
+         *      The buckets are walked in order and the stored hashes are reused so keys are not hashed again (unless the table is
+         *      in small or dense mode). Each part is reserved up front so none of them rehash while being filled.
+         *      Not available for multimaps.
+         * 
+         * @param n 
+         * @return std::vector<SimpleHashTable> 
+         */
+        std::vector<SimpleHashTable> split(size_t n)
+        {
+            static_assert(!MULTI, "Splitting is not available for multimaps");
+            std::vector<SimpleHashTable> parts(__max(n, 1));
+            size_t walkSize = getStoredHashWalkSize();
+
+            std::vector<uint64_t> counts(parts.size());
+            walkStoredHashes(0, walkSize, [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                counts[getHashRangeIndex(storedHash, parts.size())]++;
+            });
+            for(size_t i=0; i<parts.size(); i++)
+                parts[i].reserve(counts[i]);
+
+            walkStoredHashes(0, walkSize, [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                parts[getHashRangeIndex(storedHash, parts.size())].insertStored(partialHash, storedHash, std::move(arr[index]));
+            });
+            clear();
+            return parts;
+        }
+
+        /**
+         * @brief Moves every element of the parts into this table then clears the parts. The reverse of split().
+         *      Like merge(SimpleHashTable&&), the stored hashes are reused and existing keys are kept.
+         * 
+         * @param parts 
+         */
+        void concat(std::vector<SimpleHashTable>& parts)
+        {
+            uint64_t total = arr.size();
+            for(SimpleHashTable& part : parts)
+                total += part.size();
+            reserve(total);
+            for(SimpleHashTable& part : parts)
+                merge(std::move(part));
+        }
+
+        /**
+         * @brief Gets which of n equal hash ranges a hash belongs to. Only the bits of the hash the table stores are used
+         *      (the low 32 bits unless BIG is set).
+         * 
+         * @param hash 
+         * @param n 
+         * @return size_t 
+         */
+        static size_t getHashRangeIndex(uint64_t hash, size_t n)
+        {
+            if constexpr(BIG)
+            {
+                uint64_t high = n;
+                rapid_mum(&hash, &high); //high is now the top 64 bits of hash*n
+                return (size_t)high;
+            }
+            else
+                return (size_t)(((uint64_t)(uint32_t)hash * n) >> 32);
+        }
         /**
          * @brief Get the Total number of buckets allocated
          *      For reference, A bucket takes up 9 bytes if its not a big hash table.
          *          BIG is not set in the template definition.
          *          Otherwise it is 17 bytes
          *          One byte for fast checking, 4-8 bytes for full hash. 4-8 bytes for redirection pointer
+         *      Returns 0 while the table is small enough to not need buckets or while integer keys are dense enough to be used as
+         *      indices directly (dense mode).
          * 
          * @return uint64_t 
          */
@@ -635,6 +1064,19 @@ namespace smpl
             return fastHashInfo.size();
         }
 
+        /**
+         * @brief Gets the number of bytes allocated by the table itself. Includes unused capacity.
+         *      Memory owned by the elements (like the characters of a std::string) is not included.
+         * 
+         * @return uint64_t 
+         */
+        uint64_t getMemoryUsage()
+        {
+            return fastHashInfo.capacity() + redirectInfo.capacity()*sizeof(HashRedirectPair)
+                + denseIndex.capacity()*sizeof(RedirectType) + arr.capacity()*sizeof(KVStorageType)
+                + extraKeyStorage.capacity()*sizeof(Key);
+        }
+
         /**
          * @brief Gets the total number of elements added.
          *      Not the same as the total number buckets but insteads its all of the things you've added.
@@ -653,6 +1095,7 @@ namespace smpl
          *      better performance for searching but requires more memory.
          *          If you have removed a lot from your hashmap, forcing a rehash may result in less total buckets if
          *          it would not affect performance. If the total of elements is less than 40% of the total number of buckets, you should expect lower total buckets.
+         *      For integer keys, this also checks if the keys are dense enough to skip hashing and index an array directly.
          * 
          */
         void forceRehash()
@@ -660,6 +1103,92 @@ namespace smpl
             rebalance();
         }
 
+        /**
+         * @brief Adds a copy of every element from other whose key is not in this table (the union of the two).
+         *      Existing elements are kept like insert().
+         *      Both tables must use the same HashFunc (including any seed it has) since the hashes other stored for its keys
+         *      are used directly. Other's buckets are walked in order so nothing is rehashed unless a table is in small or dense mode.
+         *      Not available for multimaps.
+         * 
+         * @param other 
+         * @param threads 
+         *      Threads used to find which elements are missing before they are added. 0 uses one per hardware thread.
+         *      HashFunc and KeyEqual must be safe to call from several threads at once if this is not 1.
+         */
+        void merge(SimpleHashTable& other, size_t threads = 1)
+        {
+            mergeStored<false>(other, threads);
+        }
+
+        /**
+         * @brief Same as merge(SimpleHashTable&) but moves the missing elements out of other. Other is cleared afterwards.
+         * 
+         * @param other 
+         * @param threads 
+         */
+        void merge(SimpleHashTable&& other, size_t threads = 1)
+        {
+            mergeStored<true>(other, threads);
+            if(&other != this)
+                other.clear();
+        }
+
+        /**
+         * @brief Same as merge(SimpleHashTable&&) but for keys in both tables combine(Value& existing, Value&& incoming) is called
+         *      with other's value instead of keeping only the existing one. Useful to merge partial aggregates. Only for maps.
+         * 
+         * @tparam CombineFunc 
+         * @param other 
+         * @param combine 
+         */
+        template<typename CombineFunc, typename Q = Value, std::enable_if_t<!std::is_same_v<void, Q>, bool> = true>
+        void mergeWith(SimpleHashTable&& other, CombineFunc&& combine)
+        {
+            static_assert(!MULTI, "Set operations are not available for multimaps");
+            if(&other == this)
+                return;
+            other.walkStoredHashes(0, other.getStoredHashWalkSize(), [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                size_t sizeBefore = totalElements;
+                Iterator it = insertStored(partialHash, storedHash, std::move(other.arr[index]));
+                if(totalElements == sizeBefore)
+                    combine(it->second, std::move(other.arr[index].second));
+            });
+            other.clear();
+        }
+
+        /**
+         * @brief Removes every element whose key is not in other (the intersection of the two).
+         *      Uses the hashes this table stored for its keys to search other so both must use the same HashFunc.
+         *      The remaining elements keep their order. The buckets are rebuilt once at the end from the stored hashes
+         *      instead of shifting after every removal.
+         *      Not available for multimaps.
+         * 
+         * @param other 
+         * @param threads 
+         *      Threads used to search other. 0 uses one per hardware thread.
+         */
+        void intersect(SimpleHashTable& other, size_t threads = 1)
+        {
+            if(&other != this)
+                filterStored<true>(other, threads);
+        }
+
+        /**
+         * @brief Removes every element whose key is in other (this table minus other).
+         *      Works the same way as intersect().
+         * 
+         * @param other 
+         * @param threads 
+         */
+        void difference(SimpleHashTable& other, size_t threads = 1)
+        {
+            if(&other == this)
+                clear();
+            else
+                filterStored<false>(other, threads);
+        }
+
         /**
          * @brief Returns an iterator to the begining of the elements.
          *      Note that this is not related to the buckets but insteads its everything you added.
@@ -698,50 +1227,226 @@ namespace smpl
 		{
 			fastHashInfo.shrink_to_fit();
 			redirectInfo.shrink_to_fit();
+			denseIndex.shrink_to_fit();
 			arr.shrink_to_fit();
 			extraKeyStorage.shrink_to_fit();
 		}
-		
-    private:
-		
-        template<bool M = MULTI, typename... Args>
-		typename std::enable_if<M, void>::type
-        attemptToAdd(Args&&... args)
+
+        /**
+         * @brief Writes the table to a stream as a versioned, checksummed binary snapshot.
+         *      The buckets are written as they are so load() never needs to hash anything.
+         *      Elements are written as raw bytes if they are trivially copyable (or std::pair of those).
+         *          Otherwise each one is written with SimpleHashSerializer which handles std::string and can be specialized for other types.
+         *
+         *      The snapshot can only be loaded by the same type of table using the same hash function on a machine with the same endianness.
+         *      The stream should be opened in binary mode.
+         * 
+         * @param out 
+         */
+        void save(std::ostream& out)
         {
-			arr.emplace_back(std::list<KeyValueType>());
-			arr.back().emplace_back(std::forward<Args>(args)...);
-			extraKeyStorage.push_back(getKey(arr.back()));
+            SimpleHashSnapshotWriter writer(out);
+            SimpleHashSnapshotHeader header = {};
+            header.flags = getSnapshotFlags();
+            header.keySize = sizeof(Key);
+            header.valueSize = getValueSize();
+            header.elementSize = sizeof(KeyValueType);
+            header.redirectSize = sizeof(RedirectType);
+            header.bucketCount = fastHashInfo.size();
+            header.elementCount = arr.size();
+            header.totalElements = totalElements;
+            header.denseMin = denseMin;
+            header.denseCount = denseIndex.size();
+            std::memcpy(header.smallHashInfo, smallHashInfo.data(), SMALL_TABLE_SIZE);
+            writer.writeHeader(header);
+
+            writer.write(fastHashInfo.data(), fastHashInfo.size());
+            writer.pad();
+            writer.write(redirectInfo.data(), redirectInfo.size()*sizeof(HashRedirectPair));
+            writer.pad();
+            writer.write(denseIndex.data(), denseIndex.size()*sizeof(RedirectType));
+            writer.pad();
+            writeElements(writer);
+            writer.pad();
+            writer.finish();
         }
 
-        template<bool M = MULTI, typename... Args>
-		typename std::enable_if<!M, void>::type
-        attemptToAdd(Args&&... args)
+        /**
+         * @brief Replaces the contents of the table with a snapshot written by save().
+         *      Loading is a few large reads with no hashing.
+         *      Throws std::runtime_error if the snapshot was written by a different type of table, is truncated, or fails its checksum.
+         *          The table is left empty in that case.
+         * 
+         * @param in 
+         */
+        void load(std::istream& in)
         {
-            arr.emplace_back(std::forward<Args>(args)...);
+            SimpleHashSnapshotReader reader(in);
+            SimpleHashSnapshotHeader header = reader.readHeader();
+            if(header.flags != getSnapshotFlags() || header.keySize != sizeof(Key) || header.valueSize != getValueSize()
+                || header.elementSize != sizeof(KeyValueType) || header.redirectSize != sizeof(RedirectType))
+                throw std::runtime_error("SNAPSHOT DOES NOT MATCH TABLE TYPE");
+            
+            bool validMode = (header.bucketCount == 0 || header.denseCount == 0) && (DENSE_ALLOWED || header.denseCount == 0);
+            if(header.bucketCount == 0 && header.denseCount == 0)
+                validMode = validMode && header.elementCount <= SMALL_TABLE_SIZE;
+            if(!validMode || (header.bucketCount != 0 && header.elementCount > header.bucketCount))
+                throw std::runtime_error("INVALID SNAPSHOT HEADER");
+
+            clear();
+            try
+            {
+                if(header.bucketCount != 0)
+                    acquireBuckets(header.bucketCount, false, fastHashInfo, redirectInfo);
+                reader.read(fastHashInfo.data(), fastHashInfo.size());
+                reader.skipPadding();
+                reader.read(redirectInfo.data(), redirectInfo.size()*sizeof(HashRedirectPair));
+                reader.skipPadding();
+                denseIndex = std::vector<RedirectType>(header.denseCount);
+                reader.read(denseIndex.data(), denseIndex.size()*sizeof(RedirectType));
+                reader.skipPadding();
+                readElements(reader, header.elementCount);
+                reader.skipPadding();
+                reader.finish();
+            }
+            catch(...)
+            {
+                clear();
+                throw;
+            }
+
+            std::memcpy(smallHashInfo.data(), header.smallHashInfo, SMALL_TABLE_SIZE);
+            denseMin = header.denseMin;
+            totalElements = header.totalElements;
         }
 
-        template<typename K, typename... Args>
-        auto try_emplace(K&& key, Args&&... args)
+        /**
+         * @brief Gets the recycler used by this type of table on the current thread.
+         *      When enabled, destroyed and cleared tables hand their buckets (and element arrays small enough for a new small table)
+         *      to it and new tables take them back instead of allocating. Useful when many tables are created, filled, and destroyed over and over.
+         *          Disabled by default. Enable with getRecycler().setMaxRetainedBytes(bytes).
+         * 
+         * @return Recycler& 
+         */
+        static Recycler& getRecycler()
         {
-            if(fastHashInfo.size() == 0)
+            return Recycler::get();
+        }
+		
+    private:
+        template<bool PRECOMPUTED>
+        Iterator emplaceHashed(uint64_t actualHash, KeyValueType&& v)
+        {
+            //extra check needed if and only if its possible to overflow
+            //does nothing if BIG is enabled
+            checkIfOverflowPossible();
+			
+            const Key& key = getKey(v);
+            if(isDense())
+            {
+                uint64_t denseLocation = 0;
+                if(findOrMakeDenseSpot(key, denseLocation))
+                    return Iterator(this, denseIndex[denseLocation]-1, false);
+                if(isDense())
+                    return addDense(denseLocation, std::forward<KeyValueType>(v));
+                //key made the table too sparse. Buckets have been created so continue like normal
+            }
+            if constexpr(!PRECOMPUTED)
+                actualHash = hasher(key);
+
+            uint8_t partialHash = extractPartialHash(actualHash); //must replace top bit so its considered valid
+            if(isSmall())
             {
-                fastHashInfo = std::vector<uint8_t>(1024);
-                redirectInfo = std::vector<HashRedirectPair>(1024);
+                uint64_t smallIndex = searchSmall(partialHash, key);
+                if(smallIndex != arr.size())
+                    return appendMultimap(smallIndex, -1, std::forward<KeyValueType>(v));
+                if(arr.size() < SMALL_TABLE_SIZE)
+                    return addSmall(partialHash, std::forward<KeyValueType>(v));
+                promoteFromSmall();
+            }
+
+            RedirectType extraHash = extractPartialHashEx(actualHash);
+            uint64_t intendedLocation = actualHash % fastHashInfo.size();
+            while(!getLocationEmpty(intendedLocation))
+            {
+                if(checkForDuplicate(intendedLocation, partialHash, extraHash, key))
+                {
+					return appendMultimap(getRedirectInfo(intendedLocation), intendedLocation, std::forward<KeyValueType>(v)); //will handle the pop_back()
+                }
+
+                intendedLocation = (intendedLocation+1) % fastHashInfo.size();
             }
             
+			attemptToAdd(std::forward<KeyValueType>(v));
+            fastHashInfo[intendedLocation] = partialHash;
+            redirectInfo[intendedLocation] = {actualHash, arr.size()-1};
+            trackHash(actualHash);
+
+			Iterator returnIt = Iterator(this, arr.size()-1, false);
+			returnIt.bucketIndex = intendedLocation;
+			
+            float currentLoadBalance = (float)arr.size() / (float)fastHashInfo.size();
+            if(currentLoadBalance > MaxLoadBalance)
+            {
+				//re-balance
+                rebalance();
+            }
+			
+			totalElements++;
+            return returnIt; //Bucket index may be invalid if a rehash occured right before this returns.
+        }
+        
+		
+        template<bool M = MULTI, typename... Args>
+		typename std::enable_if<M, void>::type
+        attemptToAdd(Args&&... args)
+        {
+			arr.emplace_back(std::list<KeyValueType>());
+			arr.back().emplace_back(std::forward<Args>(args)...);
+			extraKeyStorage.push_back(getKey(arr.back()));
+        }
+
+        template<bool M = MULTI, typename... Args>
+		typename std::enable_if<!M, void>::type
+        attemptToAdd(Args&&... args)
+        {
+            arr.emplace_back(std::forward<Args>(args)...);
+        }
+
+        template<typename K, typename... Args>
+        auto try_emplace(K&& key, Args&&... args)
+        {
             //extra check needed if and only if its possible to overflow
             //does nothing if BIG is enabled. Otherwise throws an exception
             checkIfOverflowPossible();
+            if(isDense())
+            {
+                uint64_t denseLocation = 0;
+                if(findOrMakeDenseSpot(key, denseLocation))
+                    return Iterator(this, denseIndex[denseLocation]-1, false);
+                if(isDense())
+                    return addDense(denseLocation, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            }
             uint64_t actualHash = hasher(key);
 
             uint8_t partialHash = extractPartialHash(actualHash); //must replace top bit so its considered valid
+            if(isSmall())
+            {
+                uint64_t smallIndex = searchSmall(partialHash, key);
+                if(smallIndex != arr.size())
+                    return appendMultimap(smallIndex, -1, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+                if(arr.size() < SMALL_TABLE_SIZE)
+                    return addSmall(partialHash, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+                promoteFromSmall();
+            }
+
             RedirectType extraHash = extractPartialHashEx(actualHash);
             uint64_t intendedLocation = actualHash % fastHashInfo.size();
 			while(!getLocationEmpty(intendedLocation))
             {
 				if(checkForDuplicate(intendedLocation, partialHash, extraHash, key))
 				{
-					return appendMultimap(intendedLocation, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+					return appendMultimap(getRedirectInfo(intendedLocation), intendedLocation, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
 				}
 
                 intendedLocation = (intendedLocation+1) % fastHashInfo.size();
@@ -752,6 +1457,7 @@ namespace smpl
 			
             fastHashInfo[intendedLocation] = partialHash;
             redirectInfo[intendedLocation] = {actualHash, arr.size()-1};
+            trackHash(actualHash);
 
 			
 			Iterator returnIt = Iterator(this, arr.size()-1, false);
@@ -771,28 +1477,173 @@ namespace smpl
         template<typename P>
         auto search(const P& k)
         {
-            if(UNLIKELY(arr.size() == 0))
+            return searchHashed<false>(0, k);
+        }
+
+        template<bool PRECOMPUTED, typename P>
+        Iterator searchHashed(uint64_t actualHash, const P& k)
+        {
+            size_t bucketIndex = -1;
+            uint64_t index = searchIn<PRECOMPUTED>(getSearchView(), hasher, keyEqualFunc, actualHash, k, bucketIndex);
+            if(index == arr.size())
                 return end();
-            
-            uint64_t actualHash = hasher(k);
+            Iterator returnIt = Iterator(this, index, false);
+            returnIt.bucketIndex = bucketIndex;
+            return returnIt;
+        }
+
+        //Pointers to everything a search reads. The table searches through one over its own vectors and MappedSimpleHashTable
+        //  through one over a mapped snapshot so both run exactly the same probe (searchIn()).
+        struct SearchView
+        {
+            const uint8_t* fastHashInfo = nullptr;
+            const HashRedirectPair* redirectInfo = nullptr;
+            uint64_t bucketCount = 0; //0 in small and dense mode
+            const RedirectType* denseIndex = nullptr;
+            uint64_t denseCount = 0; //0 unless in dense mode
+            uint64_t denseMin = 0;
+            const uint8_t* smallHashInfo = nullptr; //SMALL_TABLE_SIZE fingerprints
+            const KVStorageType* elements = nullptr;
+            const Key* extraKeys = nullptr; //only for a multimap
+            uint64_t elementCount = 0;
+        };
+
+        SearchView getSearchView()
+        {
+            return {fastHashInfo.data(), redirectInfo.data(), fastHashInfo.size(), denseIndex.data(), isDense() ? denseIndex.size() : 0,
+                denseMin, smallHashInfo.data(), arr.data(), extraKeyStorage.data(), arr.size()};
+        }
+
+        //returns the index of the element with key k or view.elementCount if it does not exist.
+        //  bucketIndex receives the bucket the element was found in. It is left alone in small and dense mode.
+        template<bool PRECOMPUTED, typename H, typename KE, typename P>
+        static uint64_t searchIn(const SearchView& view, H& hasher, KE& keyEqualFunc, uint64_t actualHash, const P& k, size_t& bucketIndex)
+        {
+            if(UNLIKELY(view.elementCount == 0))
+                return 0;
+            if constexpr(DENSE_ALLOWED)
+            {
+                if(view.denseCount != 0)
+                    return searchDenseIn(view, keyEqualFunc, k);
+            }
+
+            if constexpr(!PRECOMPUTED)
+                actualHash = hasher(k);
             uint8_t partialHash = extractPartialHash(actualHash);
-            RedirectType extraHash = extractPartialHashEx(actualHash);
-            uint64_t location = actualHash % fastHashInfo.size();
+            if(view.bucketCount == 0)
+                return searchSmallIn(view, keyEqualFunc, partialHash, k);
+            return searchBucketsIn(view, keyEqualFunc, partialHash, actualHash, k, bucketIndex);
+        }
 
-            while(!getLocationEmpty(location))
+        //hash only needs its low bits (RedirectType) so a stored hash works the same as the full one
+        template<typename KE, typename P>
+        static uint64_t searchBucketsIn(const SearchView& view, KE& keyEqualFunc, uint8_t partialHash, uint64_t hash, const P& k, size_t& bucketIndex)
+        {
+            RedirectType extraHash = (RedirectType)hash;
+            uint64_t location = hash % view.bucketCount;
+            while(view.fastHashInfo[location] != 0)
             {
-				if(checkForDuplicate(location, partialHash, extraHash, k))
-				{
-					Iterator returnIt = Iterator(this, getRedirectInfo(location), false);
-					returnIt.bucketIndex = location;
-					return returnIt;
-				}
+                if(view.fastHashInfo[location] == partialHash && (std::is_arithmetic_v<Key> || view.redirectInfo[location].first == extraHash))
+                {
+                    uint64_t index = view.redirectInfo[location].second;
+                    if(LIKELY( keyEqualFunc(getKeyIn(view, index), k) ))
+                    {
+                        bucketIndex = location;
+                        return index;
+                    }
+                }
+                location = (location+1) % view.bucketCount;
+            }
+            return view.elementCount;
+        }
+
+        //All fingerprints are compared at once and only the matching ones need to compare keys.
+        template<typename KE, typename P>
+        static uint64_t searchSmallIn(const SearchView& view, KE& keyEqualFunc, uint8_t partialHash, const P& key)
+        {
+            uint32_t matches = 0;
+#ifdef SMPL_USE_SSE2
+            __m128i fingerprints = _mm_loadu_si128((const __m128i*)view.smallHashInfo);
+            matches = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(fingerprints, _mm_set1_epi8((char)partialHash)));
+#else
+            for(size_t i=0; i<SMALL_TABLE_SIZE; i++)
+                matches |= (uint32_t)(view.smallHashInfo[i] == partialHash) << i;
+#endif
+            matches &= ((uint32_t)1 << view.elementCount) - 1; //only the slots in use
+            while(matches != 0)
+            {
+                uint64_t index = __builtin_ctz(matches);
+                if(LIKELY( keyEqualFunc(getKeyIn(view, index), key) ))
+                    return index;
+                matches &= matches-1;
+            }
+            return view.elementCount;
+        }
+
+        template<typename KE, typename P>
+        static uint64_t searchDenseIn(const SearchView& view, KE& keyEqualFunc, const P& k)
+        {
+            if constexpr(DENSE_ALLOWED && std::is_constructible_v<Key, const P&>)
+            {
+                uint64_t location = (uint64_t)(Key)k - view.denseMin; //wraps around for keys smaller than denseMin so one compare is enough
+                if(location < view.denseCount && view.denseIndex[location] != 0)
+                    return view.denseIndex[location]-1;
+            }
+            else
+            {
+                for(uint64_t i=0; i<view.elementCount; i++)
+                {
+                    if(keyEqualFunc(getKeyIn(view, i), k))
+                        return i;
+                }
+            }
+            return view.elementCount;
+        }
+
+        static const Key& getKeyIn(const SearchView& view, uint64_t index)
+        {
+            if constexpr(MULTI)
+                return view.extraKeys[index];
+            else if constexpr(std::is_same_v<Key, KeyValueType>)
+                return view.elements[index];
+            else
+                return view.elements[index].first;
+        }
+
+        //finds the bucket that redirects to arr[index]. hash is the hash of its key. Only compares indices, never keys.
+        //The element must exist and the table must not be small or dense.
+        uint64_t findBucketOfIndex(uint64_t hash, uint64_t index)
+        {
+            uint8_t partialHash = extractPartialHash(hash);
+            RedirectType extraHash = extractPartialHashEx(hash);
+            uint64_t location = hash % fastHashInfo.size();
+            
+            //it exists so we can skip the extra work of checking free slots.
+            while(true)
+            {
+                if(getPartialHash(location) == partialHash) //fast path but 2 checks which may be unnecessary
+                {
+                    if(comparePartialHashEx(location, extraHash))
+                    {
+                        if(getRedirectInfo(location) == index)
+                            return location;
+                    }
+                }
                 location = (location+1) % fastHashInfo.size();
             }
-            return end();
         }
 
-        auto remove(const Iterator& it, bool deleteAll)
+        //iterator to arr[index] with its bucket index set so erasing it does not search for the key again
+        Iterator getIteratorWithBucket(uint64_t index)
+        {
+            Iterator it = Iterator(this, index, false);
+            if(!isSmall() && !isDense())
+                it.bucketIndex = findBucketOfIndex(hasher(getKey(arr[index])), index);
+            return it;
+        }
+
+        //extracted receives the removed element instead of it being destroyed
+        auto remove(const Iterator& it, bool deleteAll, std::optional<KVStorageType>* extracted = nullptr)
         {
             if(UNLIKELY(arr.size() == 0))
                 return end();
@@ -816,12 +1667,31 @@ namespace smpl
 				}
 			}
 
+			if(isDense())
+			{
+				removeDense(it.index, extracted);
+				totalElements -= elementCounter;
+				checkDenseStillValid();
+				if(it.all)
+					return Iterator(this, it.index, true);
+				return end();
+			}
+			if(isSmall())
+			{
+				//no buckets so the index is all that is needed
+				removeSmall(it.index, extracted);
+				totalElements -= elementCounter;
+				if(it.all)
+					return Iterator(this, it.index, true);
+				return end();
+			}
+
 			Iterator newIT = it;
 			//slower path
-			if(it.rehashCounter != rehashCounter || it.bucketIndex == -1)
+			if(it.rehashCounter != rehashCounter || it.bucketIndex == (uint64_t)-1)
 			{
 				//invalid bucket index. Recompute (search for it again)
-				newIT = find(it->first);
+				newIT = find(getKey(*it));
 				newIT.all = it.all;
 			}
 
@@ -830,55 +1700,38 @@ namespace smpl
 				return end(); //something very very odd happened.
 
 			uint64_t bucketLocation = newIT.bucketIndex;
-            uint8_t currentPartialHash = getPartialHash(bucketLocation);
-            RedirectType currentHash = getPartialHashEx(bucketLocation);
             
             //if found, find the location of the last item in arr and swap that with our current spot
 
-            uint64_t lastSpotHash = hasher(getKey(arr.back()));
-            uint8_t lastSpotPartialHash = extractPartialHash(lastSpotHash);
-            RedirectType lastSpotExtraHash = extractPartialHashEx(lastSpotHash);
-            uint64_t lastSpotLocation = lastSpotHash % fastHashInfo.size();
-            
-            //it exists so we can skip the extra work of checking free slots.
-            while(true)
-            {
-                if(getPartialHash(lastSpotLocation) == lastSpotPartialHash) //fast path but 2 checks which may be unnecessary
-                {
-                    if(comparePartialHashEx(lastSpotLocation, lastSpotExtraHash))
-                    {
-                        if(getRedirectInfo(lastSpotLocation) == (arr.size()-1))
-                            break;
-                    }
-                }
-                lastSpotLocation = (lastSpotLocation+1) % fastHashInfo.size();
-            }
+            uint64_t lastSpotLocation = findBucketOfIndex(hasher(getKey(arr.back())), arr.size()-1);
 
             //set current location to be deleted
             fastHashInfo[bucketLocation] = 0;
             
             //swap data and pop back which completes the deletion
-			swapDataStorageAndDelete(it.index);
+			swapDataStorageAndDelete(it.index, extracted);
 			swapExtraKeyStorageAndDelete(it.index);
 
             //swap locations too
             redirectInfo[lastSpotLocation].second = redirectInfo[bucketLocation].second;
 
-            //extra step. shift data back till we hit an empty spot or we hit a node that is in its desired spot
-            uint64_t previousLocation = bucketLocation;
+            //extra step. shift data back till we hit an empty spot.
+            //A node may only fill the hole if the hole is between its desired spot and where it currently is.
+            //Nodes that can't move are skipped instead of stopping since nodes after them may still belong in the hole.
+            uint64_t holeLocation = bucketLocation;
             bucketLocation = (bucketLocation+1) % fastHashInfo.size();
 
             while(!getLocationEmpty(bucketLocation))
             {
-                if(getDistanceFromDesiredSpot(bucketLocation) > 0)
+                uint64_t distanceToHole = (bucketLocation >= holeLocation) ? (bucketLocation - holeLocation) : (bucketLocation+fastHashInfo.size() - holeLocation);
+                if(getDistanceFromDesiredSpot(bucketLocation) >= distanceToHole)
                 {
-                    fastHashInfo[previousLocation] = fastHashInfo[bucketLocation];
-                    redirectInfo[previousLocation] = redirectInfo[bucketLocation];
+                    fastHashInfo[holeLocation] = fastHashInfo[bucketLocation];
+                    redirectInfo[holeLocation] = redirectInfo[bucketLocation];
+                    fastHashInfo[bucketLocation] = 0;
+                    holeLocation = bucketLocation;
                 }
-                else
-                    break;
 
-                previousLocation = bucketLocation;
                 bucketLocation = (bucketLocation+1) % fastHashInfo.size();
             }
 
@@ -929,8 +1782,584 @@ namespace smpl
 			return 1;
 		}
 
+        NodeHandle extractAt(Iterator it)
+        {
+            static_assert(!MULTI, "Node handles are not available for multimaps");
+            NodeHandle node;
+            if(it == end())
+                return node;
+
+            if(isSmall() || isDense())
+            {
+                uint64_t actualHash = hasher(getKey(*it));
+                node.partialHash = extractPartialHash(actualHash);
+                node.storedHash = extractPartialHashEx(actualHash);
+            }
+            else
+            {
+                if(it.rehashCounter != rehashCounter || it.bucketIndex == (uint64_t)-1)
+                    it = find(getKey(*it));
+                node.partialHash = getPartialHash(it.bucketIndex);
+                node.storedHash = getPartialHashEx(it.bucketIndex);
+            }
+            remove(it, true, &node.element);
+            return node;
+        }
+
+        //Set algebra with stored hashes. Bucket positions are the stored hash modulo the bucket count like resizeBuckets() so
+        //another table's stored hash finds the same home slot that hashing the key would.
+        //Small and dense tables have no stored hashes so their keys are hashed.
+        size_t getStoredHashWalkSize()
+        {
+            return (isSmall() || isDense()) ? arr.size() : fastHashInfo.size();
+        }
+
+        //calls func(position, partialHash, storedHash, arrIndex) for every element in the positions [start, end)
+        template<typename F>
+        void walkStoredHashes(size_t start, size_t end, F&& func)
+        {
+            if(isSmall() || isDense())
+            {
+                for(size_t i=start; i<end; i++)
+                {
+                    uint64_t actualHash = hasher(getKey(arr[i]));
+                    func(i, extractPartialHash(actualHash), extractPartialHashEx(actualHash), i);
+                }
+                return;
+            }
+            for(size_t i=start; i<end; i++)
+            {
+                if(!getLocationEmpty(i))
+                    func(i, getPartialHash(i), getPartialHashEx(i), getRedirectInfo(i));
+            }
+        }
+
+        //returns the index into arr of the key or arr.size() if it does not exist
+        template<typename P>
+        uint64_t searchStored(uint8_t partialHash, RedirectType storedHash, const P& key)
+        {
+            if(UNLIKELY(arr.size() == 0))
+                return 0;
+            SearchView view = getSearchView();
+            if(isDense())
+                return searchDenseIn(view, keyEqualFunc, key);
+            if(isSmall())
+                return searchSmallIn(view, keyEqualFunc, partialHash, key);
+            size_t bucketIndex = -1;
+            return searchBucketsIn(view, keyEqualFunc, partialHash, storedHash, key, bucketIndex);
+        }
+
+        //v is not touched if the key already exists
+        Iterator insertStored(uint8_t partialHash, RedirectType storedHash, KeyValueType&& v)
+        {
+            if(isSmall() || isDense())
+                return emplace(std::move(v));
+            checkIfOverflowPossible();
+
+            uint64_t location = storedHash % fastHashInfo.size();
+            while(!getLocationEmpty(location))
+            {
+                if(checkForDuplicate(location, partialHash, storedHash, getKey(v)))
+                {
+                    Iterator existingIt = Iterator(this, getRedirectInfo(location), false);
+                    existingIt.bucketIndex = location;
+                    return existingIt;
+                }
+                location = (location+1) % fastHashInfo.size();
+            }
+
+            attemptToAdd(std::move(v));
+            fastHashInfo[location] = partialHash;
+            redirectInfo[location] = {storedHash, arr.size()-1};
+            trackHash(storedHash);
+
+            Iterator returnIt = Iterator(this, arr.size()-1, false);
+            returnIt.bucketIndex = location;
+            totalElements++;
+            if((float)arr.size() / (float)fastHashInfo.size() > MaxLoadBalance)
+                rebalance();
+            return returnIt;
+        }
+
+        //splits [0, count) between threads. Runs on the calling thread if there is not enough work to split.
+        template<typename F>
+        static void runStoredParallel(size_t count, size_t threads, F&& func)
+        {
+            if(threads == 0)
+                threads = __max(std::thread::hardware_concurrency(), 1);
+            threads = __min(threads, count / 4096);
+            if(threads <= 1)
+            {
+                func(0, count);
+                return;
+            }
+
+            size_t perThread = (count + threads - 1) / threads;
+            runSimpleHashThreads((count + perThread - 1) / perThread, [&](size_t thread)
+            {
+                func(thread*perThread, __min((thread+1)*perThread, count));
+            });
+        }
+
+        template<bool MOVE>
+        void mergeStored(SimpleHashTable& other, size_t threads)
+        {
+            static_assert(!MULTI, "Set operations are not available for multimaps");
+            if(&other == this)
+                return;
+
+            auto addElement = [&](uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                if constexpr(MOVE)
+                    insertStored(partialHash, storedHash, std::move(other.arr[index]));
+                else
+                    insertStored(partialHash, storedHash, KeyValueType(other.arr[index]));
+            };
+
+            size_t walkSize = other.getStoredHashWalkSize();
+            if(threads == 1)
+            {
+                other.walkStoredHashes(0, walkSize, [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+                {
+                    addElement(partialHash, storedHash, index);
+                });
+                return;
+            }
+
+            //find what is missing in parallel then add it with one reserve
+            std::vector<uint8_t> missing(walkSize);
+            runStoredParallel(walkSize, threads, [&](size_t start, size_t end)
+            {
+                other.walkStoredHashes(start, end, [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+                {
+                    missing[position] = searchStored(partialHash, storedHash, getKey(other.arr[index])) == arr.size();
+                });
+            });
+
+            uint64_t missingCount = 0;
+            for(uint8_t m : missing)
+                missingCount += m;
+            reserve(arr.size() + missingCount);
+            other.walkStoredHashes(0, walkSize, [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+            {
+                if(missing[position])
+                    addElement(partialHash, storedHash, index);
+            });
+        }
+
+        //keeps the elements that are (KEEP_FOUND) or are not in other
+        template<bool KEEP_FOUND>
+        void filterStored(SimpleHashTable& other, size_t threads)
+        {
+            static_assert(!MULTI, "Set operations are not available for multimaps");
+            std::vector<uint8_t> keep(arr.size());
+            runStoredParallel(getStoredHashWalkSize(), threads, [&](size_t start, size_t end)
+            {
+                walkStoredHashes(start, end, [&](size_t position, uint8_t partialHash, RedirectType storedHash, uint64_t index)
+                {
+                    bool found = other.searchStored(partialHash, storedHash, getKey(arr[index])) != other.arr.size();
+                    keep[index] = (found == KEEP_FOUND);
+                });
+            });
+
+            removeUnkept(keep);
+        }
+
+        //Removes every element in arr where keep is 0 without reading their keys so they may have been moved from.
+        void removeUnkept(const std::vector<uint8_t>& keep)
+        {
+            if(isSmall() || isDense())
+            {
+                //no buckets to rebuild. Going backwards means only elements already checked get moved by a removal.
+                for(size_t i=arr.size(); i-- > 0;)
+                {
+                    if(keep[i])
+                        continue;
+                    if(isDense())
+                        removeDense(i); //the keys are integers so a moved from key is still valid
+                    else
+                        removeSmall(i);
+                    totalElements--;
+                }
+                if(isDense())
+                    checkDenseStillValid();
+                return;
+            }
+
+            std::vector<RedirectType> newIndex(arr.size());
+            size_t kept = 0;
+            for(size_t i=0; i<arr.size(); i++)
+            {
+                if(!keep[i])
+                    continue;
+                newIndex[i] = kept;
+                if(kept != i)
+                    arr[kept] = std::move(arr[i]);
+                kept++;
+            }
+            if(kept == arr.size())
+                return;
+            arr.erase(arr.begin() + kept, arr.end());
+
+            std::vector<uint8_t> newHashInfo;
+            std::vector<HashRedirectPair> newRedirectInfo;
+            acquireBuckets(fastHashInfo.size(), false, newHashInfo, newRedirectInfo);
+            for(size_t i=0; i<fastHashInfo.size(); i++)
+            {
+                if(getLocationEmpty(i) || !keep[getRedirectInfo(i)])
+                    continue;
+                uint64_t location = getPartialHashEx(i) % newHashInfo.size();
+                while(!getLocationEmpty(location, newHashInfo))
+                    location = (location+1) % newHashInfo.size();
+                newHashInfo[location] = fastHashInfo[i];
+                newRedirectInfo[location] = {getPartialHashEx(i), newIndex[getRedirectInfo(i)]};
+            }
+            releaseBuckets(fastHashInfo, redirectInfo);
+            fastHashInfo = std::move(newHashInfo);
+            redirectInfo = std::move(newRedirectInfo);
+            rehashCounter++;
+            totalElements = arr.size();
+            rebalance(); //may shrink, become dense or go back to small mode
+        }
+
+        static constexpr uint32_t getSnapshotFlags()
+        {
+            return (MULTI ? SNAPSHOT_FLAG_MULTI : 0)
+                | (BIG ? SNAPSHOT_FLAG_BIG : 0)
+                | (std::is_same_v<void, Value> ? SNAPSHOT_FLAG_SET : 0)
+                | ((!MULTI && is_raw_serializable_v<KeyValueType>) ? SNAPSHOT_FLAG_RAW_ELEMENTS : 0);
+        }
+
+        static constexpr uint32_t getValueSize()
+        {
+            if constexpr(std::is_same_v<void, Value>)
+                return 0;
+            else
+                return sizeof(Value);
+        }
+
+        void writeElements(SimpleHashSnapshotWriter& writer)
+        {
+            if constexpr(MULTI)
+            {
+                for(const std::list<KeyValueType>& elements : arr)
+                {
+                    writer.writeRaw((uint64_t)elements.size());
+                    for(const KeyValueType& v : elements)
+                        SimpleHashSerializer<KeyValueType>::write(writer, v);
+                }
+            }
+            else if constexpr(is_raw_serializable_v<KeyValueType>)
+                writer.write(arr.data(), arr.size()*sizeof(KeyValueType));
+            else
+            {
+                for(const KeyValueType& v : arr)
+                    SimpleHashSerializer<KeyValueType>::write(writer, v);
+            }
+        }
+
+        void readElements(SimpleHashSnapshotReader& reader, uint64_t count)
+        {
+            arr.reserve(count);
+            if constexpr(MULTI)
+            {
+                for(uint64_t i=0; i<count; i++)
+                {
+                    uint64_t listSize = 0;
+                    reader.readRaw(listSize);
+                    arr.emplace_back();
+                    for(uint64_t j=0; j<listSize; j++)
+                        arr.back().push_back(SimpleHashSerializer<KeyValueType>::read(reader));
+                    extraKeyStorage.push_back(getKey(arr.back()));
+                }
+            }
+            else if constexpr(is_raw_serializable_v<KeyValueType> && std::is_default_constructible_v<KeyValueType>)
+            {
+                arr.resize(count);
+                reader.read(arr.data(), count*sizeof(KeyValueType));
+            }
+            else if constexpr(is_raw_serializable_v<KeyValueType>)
+            {
+                //written as one raw block too but each element has to be constructed from its bytes
+                std::vector<unsigned char> buffer(__max(RAW_READ_CHUNK / sizeof(KeyValueType), 1) * sizeof(KeyValueType));
+                for(uint64_t i=0; i<count; )
+                {
+                    size_t amount = (size_t)__min(count - i, buffer.size() / sizeof(KeyValueType));
+                    reader.read(buffer.data(), amount*sizeof(KeyValueType));
+                    for(size_t j=0; j<amount; j++)
+                        arr.push_back(SimpleHashRawElement<KeyValueType>::fromBytes(buffer.data() + j*sizeof(KeyValueType)));
+                    i += amount;
+                }
+            }
+            else
+            {
+                for(uint64_t i=0; i<count; i++)
+                    arr.push_back(SimpleHashSerializer<KeyValueType>::read(reader));
+            }
+        }
+
+        constexpr bool isSmall()
+        {
+            return fastHashInfo.size() == 0 && !isDense();
+        }
+
+        //returns the index into arr of the element with the given key or arr.size() if it does not exist.
+        template<typename P>
+        uint64_t searchSmall(uint8_t partialHash, const P& key)
+        {
+            return searchSmallIn(getSearchView(), keyEqualFunc, partialHash, key);
+        }
+
+        template<typename... Args>
+        Iterator addSmall(uint8_t partialHash, Args&&... args)
+        {
+            if(UNLIKELY(arr.capacity() == 0))
+                arr = acquireElements(SMALL_TABLE_SIZE);
+            attemptToAdd(std::forward<Args>(args)...);
+            smallHashInfo[arr.size()-1] = partialHash;
+            totalElements++;
+            if(UNLIKELY(trackedFilter != nullptr))
+                trackHash(hasher(getKey(arr.back())));
+            return Iterator(this, arr.size()-1, false);
+        }
+
+        void removeSmall(uint64_t index, std::optional<KVStorageType>* extracted = nullptr)
+        {
+            smallHashInfo[index] = smallHashInfo[arr.size()-1];
+            smallHashInfo[arr.size()-1] = 0;
+            swapDataStorageAndDelete(index, extracted);
+            swapExtraKeyStorageAndDelete(index);
+        }
+
+        //adds a new key to the tracked filter if there is one (see setTrackedFilter())
+        void trackHash(uint64_t hash)
+        {
+            if(UNLIKELY(trackedFilter != nullptr))
+                trackedFilter->addHash(hash);
+        }
+
+        //These only go through the recycler if it is enabled and still alive on this thread (see Recycler::getIfEnabled())
+        static void acquireBuckets(size_t size, bool allowLarger, std::vector<uint8_t>& hashInfo, std::vector<HashRedirectPair>& redirectInfo)
+        {
+            Recycler* recycler = Recycler::getIfEnabled();
+            if(recycler != nullptr)
+            {
+                recycler->acquireBuckets(size, allowLarger, hashInfo, redirectInfo);
+                return;
+            }
+            hashInfo = std::vector<uint8_t>(size);
+            redirectInfo = std::vector<HashRedirectPair>(size);
+        }
+
+        static void releaseBuckets(std::vector<uint8_t>& hashInfo, std::vector<HashRedirectPair>& redirectInfo)
+        {
+            Recycler* recycler = Recycler::getIfEnabled();
+            if(recycler != nullptr)
+            {
+                recycler->releaseBuckets(hashInfo, redirectInfo);
+                return;
+            }
+            hashInfo = std::vector<uint8_t>();
+            redirectInfo = std::vector<HashRedirectPair>();
+        }
+
+        static std::vector<KVStorageType> acquireElements(size_t minCapacity)
+        {
+            Recycler* recycler = Recycler::getIfEnabled();
+            return (recycler != nullptr) ? recycler->acquireElements(minCapacity) : std::vector<KVStorageType>();
+        }
+
+        static void releaseElements(std::vector<KVStorageType>& elements)
+        {
+            Recycler* recycler = Recycler::getIfEnabled();
+            if(recycler != nullptr)
+                recycler->releaseElements(elements, SMALL_TABLE_SIZE*2); //addSmall() is the only place element arrays are acquired
+        }
+
+        //Moves from linear searching to the buckets. Only a few elements exist so rehashing them is cheap.
+        void promoteFromSmall()
+        {
+            rebuildBuckets(1024);
+        }
+
+        void demoteToSmall()
+        {
+            smallHashInfo = {};
+            for(size_t i=0; i<arr.size(); i++)
+                smallHashInfo[i] = extractPartialHash(hasher(getKey(arr[i])));
+            
+            releaseBuckets(fastHashInfo, redirectInfo);
+            denseIndex = std::vector<RedirectType>();
+            rehashCounter++;
+        }
+
+        //Rehashes every key into a new set of buckets. Used when there were no buckets before.
+        void rebuildBuckets(size_t newSize)
+        {
+            //recycled buckets may be up to twice as many which saves a rehash as the table grows
+            acquireBuckets(newSize, true, fastHashInfo, redirectInfo);
+            denseIndex = std::vector<RedirectType>();
+            rehashCounter++;
+            for(size_t i=0; i<arr.size(); i++)
+            {
+                uint64_t actualHash = hasher(getKey(arr[i]));
+                uint64_t location = actualHash % fastHashInfo.size();
+                while(!getLocationEmpty(location))
+                    location = (location+1) % fastHashInfo.size();
+                
+                fastHashInfo[location] = extractPartialHash(actualHash);
+                redirectInfo[location] = {actualHash, i};
+            }
+        }
+
+        //Dense mode. Only for integer keys (not multimaps) using the default HashFunc and KeyEqual.
+        //  If the keys fill at least 1/DENSE_RANGE_FACTOR of the range between the smallest and largest key, the key
+        //  itself is used as the index into denseIndex which points into arr. No hashing and no buckets.
+        //  Goes back to the buckets if the keys become too spread out.
+        constexpr bool isDense()
+        {
+            if constexpr(DENSE_ALLOWED)
+                return denseIndex.size() != 0;
+            return false;
+        }
+
+        template<typename K>
+        constexpr uint64_t getDenseOffset(const K& key)
+        {
+            if constexpr(DENSE_ALLOWED)
+                return (uint64_t)(Key)key - denseMin; //wraps around for keys smaller than denseMin so one compare is enough
+            return 0;
+        }
+
+        //switches to dense mode if the keys are close enough together. Returns if the table is now dense
+        bool tryMakeDense()
+        {
+            if constexpr(!DENSE_ALLOWED)
+                return false;
+            else
+            {
+                Key minKey = getKey(arr[0]);
+                Key maxKey = minKey;
+                for(size_t i=1; i<arr.size(); i++)
+                {
+                    const Key& k = getKey(arr[i]);
+                    minKey = (k < minKey) ? k : minKey;
+                    maxKey = (k > maxKey) ? k : maxKey;
+                }
+                uint64_t range = (uint64_t)maxKey - (uint64_t)minKey + 1;
+                if(range == 0 || range > arr.size()*DENSE_RANGE_FACTOR)
+                    return false;
+                
+                denseMin = (uint64_t)minKey;
+                denseIndex = std::vector<RedirectType>(range);
+                for(size_t i=0; i<arr.size(); i++)
+                    denseIndex[getDenseOffset(getKey(arr[i]))] = i+1;
+                
+                releaseBuckets(fastHashInfo, redirectInfo);
+                rehashCounter++;
+                return true;
+            }
+        }
+
+        //goes back to buckets sized to not need a rehash right away.
+        void leaveDense()
+        {
+            size_t newSize = 1024;
+            while(arr.size() >= newSize*MaxLoadBalance)
+                newSize *= 2;
+            rebuildBuckets(newSize);
+        }
+
+        //returns true if the key already exists. Otherwise location is set to where it will be placed.
+        //The range may grow to fit the key. If it can't while staying dense, the table leaves dense mode.
+        template<typename K>
+        bool findOrMakeDenseSpot(const K& key, uint64_t& location)
+        {
+            location = getDenseOffset(key);
+            if(LIKELY(location < denseIndex.size()))
+                return denseIndex[location] != 0;
+            
+            uint64_t distanceBelow = (uint64_t)0 - location; //same as denseMin - key
+            bool below = distanceBelow < location; //whichever direction is closer
+            uint64_t needed = below ? denseIndex.size() + distanceBelow : location+1;
+            uint64_t allowed = (arr.size()+1)*DENSE_RANGE_FACTOR;
+            if(needed > allowed)
+            {
+                leaveDense();
+                return false;
+            }
+
+            //grow with some extra space so ordered inserts don't copy every time
+            uint64_t extra = __min(allowed - needed, needed/2);
+            if(below)
+            {
+                uint64_t shift = distanceBelow + extra;
+                std::vector<RedirectType> newDenseIndex = std::vector<RedirectType>(denseIndex.size() + shift);
+                std::memcpy(newDenseIndex.data() + shift, denseIndex.data(), denseIndex.size()*sizeof(RedirectType));
+                denseIndex = std::move(newDenseIndex);
+                denseMin -= shift;
+            }
+            else
+                denseIndex.resize(needed + extra);
+            
+            location = getDenseOffset(key);
+            return false;
+        }
+
+        template<typename... Args>
+        Iterator addDense(uint64_t location, Args&&... args)
+        {
+            attemptToAdd(std::forward<Args>(args)...);
+            denseIndex[location] = arr.size();
+            totalElements++;
+            if(UNLIKELY(trackedFilter != nullptr))
+                trackHash(hasher(getKey(arr.back())));
+            return Iterator(this, arr.size()-1, false);
+        }
+
+        template<typename P>
+        Iterator searchDense(const P& k)
+        {
+            uint64_t index = searchDenseIn(getSearchView(), keyEqualFunc, k);
+            return (index == arr.size()) ? end() : Iterator(this, index, false);
+        }
+
+        void removeDense(uint64_t index, std::optional<KVStorageType>* extracted = nullptr)
+        {
+            denseIndex[getDenseOffset(getKey(arr[index]))] = 0;
+            if(index != arr.size()-1)
+                denseIndex[getDenseOffset(getKey(arr.back()))] = index+1;
+            swapDataStorageAndDelete(index, extracted);
+        }
+
+        //Called after removing. Too few keys over the range wastes memory so go back to the buckets (or small mode).
+        void checkDenseStillValid()
+        {
+            if(arr.size() <= SMALL_TABLE_SIZE)
+                demoteToSmall();
+            else if(denseIndex.size() > arr.size()*DENSE_SPARSE_FACTOR)
+                leaveDense();
+        }
+
         void rebalance()
         {
+            if(isSmall())
+                return;
+            if(arr.size() <= SMALL_TABLE_SIZE)
+            {
+                //few enough elements to go back to searching linearly. Release the buckets.
+                demoteToSmall();
+                return;
+            }
+            if(tryMakeDense())
+                return;
+            if(isDense())
+            {
+                //too spread out for dense mode now.
+                leaveDense();
+                return;
+            }
+
             //Allowed to scale down the total buckets too now.
             size_t newSize = fastHashInfo.size();
             double load = (double)arr.size() / (double)fastHashInfo.size();
@@ -940,9 +2369,15 @@ namespace smpl
                 newSize = fastHashInfo.size()*2;
             
             newSize = __max(newSize, 1024); //not allowed to have less than 1024 buckets
+            resizeBuckets(newSize);
+        }
 
-            std::vector<uint8_t> newHashInfo = std::vector<uint8_t>(newSize);
-            std::vector<HashRedirectPair> newRedirectInfo = std::vector<HashRedirectPair>(newSize);
+        //moves every bucket into newSize buckets using the stored hashes
+        void resizeBuckets(size_t newSize)
+        {
+            std::vector<uint8_t> newHashInfo;
+            std::vector<HashRedirectPair> newRedirectInfo;
+            acquireBuckets(newSize, false, newHashInfo, newRedirectInfo);
 			rehashCounter++;
 
             for(size_t i=0; i<fastHashInfo.size(); i++)
@@ -951,6 +2386,7 @@ namespace smpl
                     specialInsert(i, newHashInfo, newRedirectInfo);
             }
 
+            releaseBuckets(fastHashInfo, redirectInfo);
             fastHashInfo = std::move(newHashInfo);
             redirectInfo = std::move(newRedirectInfo);
         }
@@ -1018,7 +2454,7 @@ namespace smpl
             return (loc >= desiredLocation) ? (loc - desiredLocation) : (loc+fastHashInfo.size() - desiredLocation);
         }
 
-        constexpr uint8_t extractPartialHash(uint64_t hash)
+        static constexpr uint8_t extractPartialHash(uint64_t hash)
         {
             uint64_t temp = rapid_mix(hash, std::uint64_t{0x9ddfea08eb382d69});
             return temp | VALID_BIT;
@@ -1050,7 +2486,7 @@ namespace smpl
 
         //Value
         template<class K = KeyValueType>
-        typename std::enable_if<std::is_same_v<Key, K>, const Value&>::type
+        typename std::enable_if<std::is_same_v<Key, K>, const K&>::type
         getValue(const KeyValueType& v)
         {
             return v;
@@ -1066,7 +2502,7 @@ namespace smpl
 
         //std::pair<Key, Value>
         template<class K = KeyValueType>
-        typename std::enable_if<!std::is_same_v<Key, K>, const Value&>::type
+        typename std::enable_if<!std::is_same_v<Key, K>, const typename K::second_type&>::type
         getValue(const KeyValueType& v)
         {
             return v.second;
@@ -1077,16 +2513,16 @@ namespace smpl
 			return getKey(v.back());
 		}
         
-		const Value& getValue(const std::list<KeyValueType>& v)
+		template<class K = KeyValueType>
+		const auto& getValue(const std::list<K>& v)
 		{
 			return getValue(v.back());
 		}
 
 		template<bool M = MULTI, typename... Args>
 		typename std::enable_if<M, Iterator>::type
-        appendMultimap(uint64_t intendedLocation, Args&&... v)
+        appendMultimap(uint64_t actualLocation, uint64_t intendedLocation, Args&&... v)
 		{
-			uint64_t actualLocation = getRedirectInfo(intendedLocation);
 			arr[actualLocation].emplace_back(std::forward<Args>(v)...);
 			totalElements++;
 			
@@ -1097,17 +2533,18 @@ namespace smpl
 
 		template<bool M = MULTI, typename... Args>
 		typename std::enable_if<!M, Iterator>::type
-        appendMultimap(uint64_t intendedLocation, Args&&... v)
+        appendMultimap(uint64_t actualLocation, uint64_t intendedLocation, Args&&... v)
 		{
-			uint64_t actualLocation = getRedirectInfo(intendedLocation);
 			Iterator returnIt = Iterator(this, actualLocation, false);
 			returnIt.bucketIndex = intendedLocation;
 			return returnIt;
 		}
 		
-		void swapDataStorageAndDelete(uint64_t index)
+		void swapDataStorageAndDelete(uint64_t index, std::optional<KVStorageType>* extracted = nullptr)
 		{
 			std::swap(arr.back(), arr[index]);
+			if(extracted != nullptr)
+				extracted->emplace(std::move(arr.back()));
 			arr.pop_back();
 		}
 		
@@ -1162,8 +2599,37 @@ namespace smpl
 		
 		friend SimpleHashTableIterator<Key, Value, MULTI, HashFunc, KeyEqual, BIG>;
 
+        //these use the same bucket layout outside of the table so they need the same fingerprint and flags
+        template<typename K, typename V, typename H, typename KE, bool B>
+        friend class MappedSimpleHashTable;
+        template<typename K, typename V, typename H, typename KE, bool B>
+        friend class SharedSimpleHashMap;
+        template<typename K, typename V, typename H, typename KE, bool B>
+        friend class CowSimpleHashTable;
+        template<typename K, typename V, typename H, typename KE, bool B, typename VH>
+        friend class DigestSimpleHashTable;
+        template<typename K, typename V, typename H, typename KE, bool B>
+        friend class LruSimpleHashMap;
+
         static const uint8_t VALID_BIT = 0x80;
         const float MaxLoadBalance = 0.80;
+        static const size_t RAW_READ_CHUNK = 1<<16; //bytes read at a time when raw elements can't be read straight into arr
+
+        //Maximum number of elements stored before buckets are allocated. Matches the width of one SSE2 compare.
+        static const size_t SMALL_TABLE_SIZE = 16;
+        std::array<uint8_t, SMALL_TABLE_SIZE> smallHashInfo = {}; //fingerprints of the elements in arr while there are no buckets
+
+        //Integer keys covering at least half of their range are indexed directly. Dense mode ends if they cover less than 1/8th.
+        //  Keys are compared by value in dense mode so it is only used with the default hash function and equality.
+        static constexpr bool DENSE_ALLOWED = std::is_integral_v<Key> && !MULTI
+            && std::is_same_v<HashFunc, TestHashFunction<Key>> && std::is_same_v<KeyEqual, std::equal_to<Key>>;
+        static const size_t DENSE_RANGE_FACTOR = 2;
+        static const size_t DENSE_SPARSE_FACTOR = 8;
+        std::vector<RedirectType> denseIndex; //arr index + 1 for each key starting at denseMin. 0 == empty
+        uint64_t denseMin = 0;
+
+        bool deferredDestruction = false;
+        std::shared_ptr<SimpleHashBloomFilter> trackedFilter; //see setTrackedFilter()
 
         std::vector<uint8_t> fastHashInfo; //0x00 == empty. 0x7F == deleted (only first bit empty)
         std::vector<HashRedirectPair> redirectInfo; //redirect info + stored hash
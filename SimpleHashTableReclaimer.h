@@ -0,0 +1,232 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace smpl
+{
+    /**
+     * @brief Destroys storage handed off by hash tables (see SimpleHashTable::clear_async()) away from the thread that used it.
+     *      By default a background thread is started the first time something is retired and destroys everything as it arrives.
+     *      If the background thread is disabled, nothing is destroyed until reclaim() is called which allows destroying
+     *      a bounded amount at a time on a thread of your choosing.
+     *
+     *      Note that element destructors then run on another thread (or whenever reclaim() is called).
+     *          Elements must not depend on being destroyed on the thread that created them.
+     */
+    class SimpleHashTableReclaimer
+    {
+    public:
+        /**
+         * @brief Gets the reclaimer shared by every table.
+         *
+         * @return SimpleHashTableReclaimer&
+         */
+        static SimpleHashTableReclaimer& get()
+        {
+            static SimpleHashTableReclaimer reclaimer;
+            return reclaimer;
+        }
+
+        /**
+         * @brief Same as get() but returns nullptr once the reclaimer has been destroyed.
+         *      Tables use this so a static or global table destroyed after the reclaimer (at exit) frees its storage itself
+         *      instead of retiring it to a dead object.
+         *
+         * @return SimpleHashTableReclaimer*
+         */
+        static SimpleHashTableReclaimer* getIfAlive()
+        {
+            if(destroyed.load(std::memory_order_acquire))
+                return nullptr;
+            return &get();
+        }
+
+        ~SimpleHashTableReclaimer()
+        {
+            destroyed.store(true, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                useBackgroundThread = false;
+            }
+            stopBackgroundThread();
+            reclaim(SIZE_MAX);
+        }
+
+        /**
+         * @brief Hands off an array to be destroyed later. The array is left empty.
+         *
+         * @tparam T
+         * @param items
+         */
+        template<typename T>
+        void retire(std::vector<T>& items)
+        {
+            if(items.capacity() == 0)
+                return;
+            if constexpr(std::is_trivially_destructible_v<T>)
+                items.clear(); //only needs to be freed
+
+            std::unique_ptr<Garbage> garbage = std::make_unique<VectorGarbage<T>>(std::move(items));
+            items = std::vector<T>();
+
+            std::unique_lock<std::mutex> lock(queueMutex);
+            pendingElements += garbage->remaining();
+            queue.push_back(std::move(garbage));
+            if(useBackgroundThread && !backgroundThread.joinable())
+                startBackgroundThreadLocked();
+            lock.unlock();
+            wakeUp.notify_one();
+        }
+
+        /**
+         * @brief Destroys up to budget elements on the calling thread. Arrays are freed once all of their elements are destroyed.
+         *
+         * @param budget
+         * @return size_t
+         *      The number of elements still waiting to be destroyed.
+         */
+        size_t reclaim(size_t budget)
+        {
+            while(budget > 0)
+            {
+                std::unique_ptr<Garbage> garbage;
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    if(queue.empty())
+                        break;
+                    garbage = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                size_t before = garbage->remaining();
+                size_t after = garbage->destroySome(budget);
+                budget -= before - after;
+
+                std::lock_guard<std::mutex> lock(queueMutex);
+                pendingElements -= before - after;
+                if(after > 0)
+                    queue.push_front(std::move(garbage)); //budget ran out. Continue with it next time
+            }
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+            return pendingElements;
+        }
+
+        /**
+         * @brief Sets whether a background thread destroys retired storage. Enabled by default.
+         *      If disabled, reclaim() must be called for anything to be destroyed.
+         *
+         * @param enabled
+         */
+        void setUseBackgroundThread(bool enabled)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                useBackgroundThread = enabled;
+            }
+            if(!enabled)
+                stopBackgroundThread();
+        }
+
+        /**
+         * @brief Gets the number of elements waiting to be destroyed.
+         *
+         * @return size_t
+         */
+        size_t getPendingCount()
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            return pendingElements;
+        }
+
+    private:
+        //destroys elements in chunks so the lock is never held for long and reclaim() can stop part way through.
+        static const size_t CHUNK_SIZE = 4096;
+
+        struct Garbage
+        {
+            virtual ~Garbage(){}
+            virtual size_t remaining() = 0;
+            virtual size_t destroySome(size_t budget) = 0;
+        };
+
+        template<typename T>
+        struct VectorGarbage : public Garbage
+        {
+            VectorGarbage(std::vector<T>&& items) : items(std::move(items)) {}
+
+            size_t remaining()
+            {
+                return items.size();
+            }
+
+            //destroys from the back so nothing is moved
+            size_t destroySome(size_t budget)
+            {
+                size_t count = (budget < items.size()) ? budget : items.size();
+                items.erase(items.end() - count, items.end());
+                if(items.empty())
+                    items = std::vector<T>();
+                return items.size();
+            }
+
+            std::vector<T> items;
+        };
+
+        SimpleHashTableReclaimer(){}
+
+        void startBackgroundThreadLocked()
+        {
+            backgroundThread = std::thread([this, generation = threadGeneration](){ backgroundLoop(generation); });
+        }
+
+        //the thread is taken out under the lock so retire() can not start or replace it while it is joined.
+        //A thread started in the meantime has a new generation so it is not stopped by this call.
+        void stopBackgroundThread()
+        {
+            std::thread stopping;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                threadGeneration++;
+                stopping = std::move(backgroundThread);
+            }
+            wakeUp.notify_all();
+            if(stopping.joinable())
+                stopping.join();
+        }
+
+        void backgroundLoop(uint64_t generation)
+        {
+            while(true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    wakeUp.wait(lock, [this, generation](){ return generation != threadGeneration || !queue.empty(); });
+                    if(generation != threadGeneration)
+                        return;
+                }
+                reclaim(CHUNK_SIZE);
+            }
+        }
+
+        std::mutex queueMutex;
+        std::condition_variable wakeUp;
+        std::deque<std::unique_ptr<Garbage>> queue;
+        size_t pendingElements = 0;
+
+        std::thread backgroundThread;
+        bool useBackgroundThread = true;
+        uint64_t threadGeneration = 0; //changed to stop the running background thread
+
+        inline static std::atomic<bool> destroyed = false; //set once the reclaimer from get() is destroyed
+    };
+}
@@ -0,0 +1,272 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace smpl
+{
+    /**
+     * @brief Keeps the memory of destroyed or cleared hash tables around so new tables on the same thread can reuse it.
+     *      Bucket arrays are zeroed when they are released so a new table receives them ready to use.
+     *      Element arrays are kept empty but with their capacity so the new table does not need to grow them from nothing.
+     *
+     *      There is one recycler per thread for each table type (see SimpleHashTable::getRecycler()).
+     *      Nothing is kept until setMaxRetainedBytes() is called with a non zero value. Anything released past the limit is freed.
+     *      Memory is only handed back for the same size (or up to twice the size where a table allows it) so a small table never
+     *      ends up holding a large recycled array.
+     *      Element arrays have their own limit (setMaxRetainedElementBytes()) so they never use up the bytes kept for buckets.
+     *      Only element arrays some acquireElements() call could take are kept (see releaseElements()).
+     *
+     * @tparam HashRedirectPair
+     * @tparam KVStorageType
+     */
+    template<typename HashRedirectPair, typename KVStorageType>
+    class SimpleHashTableRecycler
+    {
+    public:
+        SimpleHashTableRecycler()
+        {
+            current = this;
+        }
+
+        ~SimpleHashTableRecycler()
+        {
+            current = nullptr;
+            if(maxRetainedBytes != 0)
+                enabledCount--;
+        }
+
+        SimpleHashTableRecycler(const SimpleHashTableRecycler& other) = delete;
+        SimpleHashTableRecycler& operator=(const SimpleHashTableRecycler& other) = delete;
+
+        /**
+         * @brief Gets the recycler for the current thread. Creates it the first time.
+         *
+         * @return SimpleHashTableRecycler&
+         */
+        static SimpleHashTableRecycler& get()
+        {
+            thread_local SimpleHashTableRecycler recycler;
+            return recycler;
+        }
+
+        /**
+         * @brief Gets the recycler for the current thread if it exists, is enabled, and has not been destroyed yet. Otherwise nullptr.
+         *      Tables use this instead of get() so a table destroyed after its thread's recycler (like a global table at exit)
+         *      does not touch it. While no recycler of this type is enabled on any thread, this is a single atomic load.
+         *
+         * @return SimpleHashTableRecycler*
+         */
+        static SimpleHashTableRecycler* getIfEnabled()
+        {
+            if(enabledCount.load(std::memory_order_relaxed) == 0)
+                return nullptr;
+            SimpleHashTableRecycler* recycler = current;
+            return (recycler != nullptr && recycler->maxRetainedBytes != 0) ? recycler : nullptr;
+        }
+
+        /**
+         * @brief Sets the maximum number of bytes kept by this recycler. Frees anything over the new limit.
+         *      0 disables recycling.
+         *
+         * @param bytes
+         */
+        void setMaxRetainedBytes(size_t bytes)
+        {
+            if(maxRetainedBytes == 0 && bytes != 0)
+                enabledCount++;
+            else if(maxRetainedBytes != 0 && bytes == 0)
+                enabledCount--;
+            maxRetainedBytes = bytes;
+            while(retainedBytes > maxRetainedBytes && !bucketPool.empty())
+            {
+                retainedBytes -= getBytes(bucketPool.front());
+                bucketPool.erase(bucketPool.begin());
+            }
+            if(maxRetainedBytes == 0)
+                trimElements(0);
+        }
+
+        /**
+         * @brief Sets the maximum number of bytes of element arrays kept. Counted separately from setMaxRetainedBytes().
+         *      Only used while recycling is enabled by setMaxRetainedBytes(). Defaults to DEFAULT_MAX_ELEMENT_BYTES.
+         *
+         * @param bytes
+         */
+        void setMaxRetainedElementBytes(size_t bytes)
+        {
+            maxRetainedElementBytes = bytes;
+            trimElements(maxRetainedElementBytes);
+        }
+
+        size_t getMaxRetainedBytes()
+        {
+            return maxRetainedBytes;
+        }
+
+        size_t getMaxRetainedElementBytes()
+        {
+            return maxRetainedElementBytes;
+        }
+
+        /**
+         * @brief Gets the bytes kept for buckets and element arrays together.
+         *
+         * @return size_t
+         */
+        size_t getRetainedBytes()
+        {
+            return retainedBytes + retainedElementBytes;
+        }
+
+        /**
+         * @brief Frees everything kept.
+         *
+         */
+        void trim()
+        {
+            bucketPool.clear();
+            elementPool.clear();
+            retainedBytes = 0;
+            retainedElementBytes = 0;
+        }
+
+        /**
+         * @brief Gets zeroed buckets with exactly size buckets or, if allowLarger is set and there are none, buckets with
+         *      at most twice as many. Allocates new buckets if nothing fits.
+         *
+         * @param size
+         * @param allowLarger
+         * @param hashInfo
+         * @param redirectInfo
+         */
+        void acquireBuckets(size_t size, bool allowLarger, std::vector<uint8_t>& hashInfo, std::vector<HashRedirectPair>& redirectInfo)
+        {
+            size_t found = bucketPool.size();
+            for(size_t i=bucketPool.size(); i>0; i--)
+            {
+                size_t storedSize = bucketPool[i-1].first.size();
+                if(storedSize == size)
+                {
+                    found = i-1;
+                    break;
+                }
+                if(allowLarger && found == bucketPool.size() && storedSize > size && storedSize <= size*2)
+                    found = i-1;
+            }
+
+            if(found == bucketPool.size())
+            {
+                hashInfo = std::vector<uint8_t>(size);
+                redirectInfo = std::vector<HashRedirectPair>(size);
+                return;
+            }
+            BucketStorage& storage = bucketPool[found];
+            retainedBytes -= getBytes(storage);
+            hashInfo = std::move(storage.first);
+            redirectInfo = std::move(storage.second);
+            bucketPool.erase(bucketPool.begin() + found);
+        }
+
+        /**
+         * @brief Takes the buckets from a table. They are zeroed now so acquireBuckets() does not have to.
+         *      Only power of 2 bucket counts are kept since those are the only sizes a table grows or shrinks to.
+         *
+         * @param hashInfo
+         * @param redirectInfo
+         */
+        void releaseBuckets(std::vector<uint8_t>& hashInfo, std::vector<HashRedirectPair>& redirectInfo)
+        {
+            BucketStorage storage = {std::move(hashInfo), std::move(redirectInfo)};
+            hashInfo = std::vector<uint8_t>();
+            redirectInfo = std::vector<HashRedirectPair>();
+
+            size_t size = storage.first.size();
+            size_t bytes = getBytes(storage);
+            if(size == 0 || (size & (size-1)) != 0 || storage.second.size() != size || retainedBytes + bytes > maxRetainedBytes)
+                return;
+
+            std::memset((void*)storage.first.data(), 0, size);
+            retainedBytes += bytes;
+            bucketPool.push_back(std::move(storage));
+        }
+
+        /**
+         * @brief Gets the most recently released element array with a capacity of at least minCapacity and at most twice that.
+         *      It is empty but keeps its old capacity. Returns an empty array with no capacity if nothing fits.
+         *
+         * @param minCapacity
+         * @return std::vector<KVStorageType>
+         */
+        std::vector<KVStorageType> acquireElements(size_t minCapacity)
+        {
+            for(size_t i=elementPool.size(); i>0; i--)
+            {
+                size_t capacity = elementPool[i-1].capacity();
+                if(capacity >= minCapacity && capacity <= minCapacity*2)
+                {
+                    std::vector<KVStorageType> result = std::move(elementPool[i-1]);
+                    elementPool.erase(elementPool.begin() + (i-1));
+                    retainedElementBytes -= capacity*sizeof(KVStorageType);
+                    return result;
+                }
+            }
+            return std::vector<KVStorageType>();
+        }
+
+        /**
+         * @brief Takes the element array from a table. All elements are destroyed now but the capacity is kept.
+         *      Arrays with a capacity over maxCapacity are freed since nothing would acquire them.
+         *
+         * @param elements
+         * @param maxCapacity
+         *      The largest capacity an acquireElements() call of the caller can return (twice its largest minCapacity).
+         */
+        void releaseElements(std::vector<KVStorageType>& elements, size_t maxCapacity)
+        {
+            std::vector<KVStorageType> storage = std::move(elements);
+            elements = std::vector<KVStorageType>();
+
+            size_t bytes = storage.capacity()*sizeof(KVStorageType);
+            if(bytes == 0 || storage.capacity() > maxCapacity || retainedElementBytes + bytes > maxRetainedElementBytes)
+                return;
+
+            storage.clear();
+            retainedElementBytes += bytes;
+            elementPool.push_back(std::move(storage));
+        }
+
+        static constexpr size_t DEFAULT_MAX_ELEMENT_BYTES = 1 << 16;
+
+    private:
+        using BucketStorage = std::pair<std::vector<uint8_t>, std::vector<HashRedirectPair>>;
+
+        static size_t getBytes(const BucketStorage& storage)
+        {
+            return storage.first.capacity() + storage.second.capacity()*sizeof(HashRedirectPair);
+        }
+
+        //frees the oldest element arrays until no more than bytes are kept
+        void trimElements(size_t bytes)
+        {
+            while(retainedElementBytes > bytes && !elementPool.empty())
+            {
+                retainedElementBytes -= elementPool.front().capacity()*sizeof(KVStorageType);
+                elementPool.erase(elementPool.begin());
+            }
+        }
+
+        std::vector<BucketStorage> bucketPool;
+        std::vector<std::vector<KVStorageType>> elementPool;
+        size_t retainedBytes = 0; //buckets only
+        size_t maxRetainedBytes = 0;
+        size_t retainedElementBytes = 0;
+        size_t maxRetainedElementBytes = DEFAULT_MAX_ELEMENT_BYTES;
+
+        inline static thread_local SimpleHashTableRecycler* current = nullptr; //cleared when this thread's recycler is destroyed
+        inline static std::atomic<size_t> enabledCount = 0; //recyclers of this type with a non zero limit on any thread
+    };
+}
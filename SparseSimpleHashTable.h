@@ -0,0 +1,523 @@
+#pragma once
+#include "ImportantInclude.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef LIKELY
+#define LIKELY(x)      __builtin_expect(!!(x), 1)
+#define UNLIKELY(x)    __builtin_expect(!!(x), 0)
+#endif
+
+namespace smpl
+{
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    class SparseSimpleHashTable;
+
+    template<typename Key, typename Value, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    using SparseSimpleHashMap = SparseSimpleHashTable<Key, Value, HashFunc, KeyEqual>;
+
+    template<typename Key, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>>
+    using SparseSimpleHashSet = SparseSimpleHashTable<Key, void, HashFunc, KeyEqual>;
+
+    template<typename Key, typename Value, typename HashFunc, typename KeyEqual>
+    struct SparseSimpleHashTableIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::conditional_t<std::is_same_v<void, Value>, Key, std::pair<Key, Value>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        SparseSimpleHashTableIterator(){}
+        SparseSimpleHashTableIterator(SparseSimpleHashTable<Key, Value, HashFunc, KeyEqual>* ptr, size_t groupIndex, size_t rank)
+        {
+            this->ptr = ptr;
+            this->groupIndex = groupIndex;
+            this->rank = rank;
+        }
+
+        SparseSimpleHashTableIterator& operator++()
+        {
+            rank++;
+            if(rank >= ptr->groupSize(groupIndex))
+            {
+                rank = 0;
+                groupIndex = ptr->nextUsedGroup(groupIndex+1);
+            }
+            return *this;
+        }
+
+        reference operator*() const
+        {
+            return ptr->groups[groupIndex].items[rank];
+        }
+        pointer operator->() const
+        {
+            return &ptr->groups[groupIndex].items[rank];
+        }
+
+        bool operator==(const SparseSimpleHashTableIterator& other) const
+        {
+            return groupIndex == other.groupIndex && rank == other.rank;
+        }
+        bool operator!=(const SparseSimpleHashTableIterator& other) const
+        {
+            return groupIndex != other.groupIndex || rank != other.rank;
+        }
+
+    private:
+        friend SparseSimpleHashTable<Key, Value, HashFunc, KeyEqual>;
+
+        SparseSimpleHashTable<Key, Value, HashFunc, KeyEqual>* ptr = nullptr;
+        size_t groupIndex = 0;
+        size_t rank = 0;
+    };
+
+    /**
+     * @brief A hash table that trades lookup speed for memory. Meant for huge tables where memory matters most.
+     *      Slots are split into groups of 64. Each group has a 64 bit occupancy bitmap and a packed array holding
+     *      only the elements in the occupied slots. The popcount of the bitmap below a slot gives its spot in the packed array.
+     *
+     *      An empty slot costs 1 bit so the table is kept at most 50% full which keeps the linear probes short.
+     *      The overhead is 16 bytes per 64 slots (the bitmap and the array pointer), under 1 byte per element.
+     *          There are no fingerprints or stored hashes so keys are compared directly and rehashed when the table grows.
+     *      Inserting or erasing moves the other elements in the group (at most 63) since the arrays are packed.
+     *
+     *      Note that whether it is a map or set depends on what template parameters are set.
+     *          To create a set, Set the Value template parameter to void
+     */
+    template<typename Key, typename Value, typename HashFunc, typename KeyEqual>
+    class SparseSimpleHashTable
+    {
+    public:
+        using KeyValueType = std::conditional_t<std::is_same_v<void, Value>, Key, std::pair<Key, Value>>;
+        using Iterator = SparseSimpleHashTableIterator<Key, Value, HashFunc, KeyEqual>;
+
+        /**
+         * @brief Construct a new Sparse Hash Table. Nothing is allocated until the first insert.
+         *
+         */
+        SparseSimpleHashTable(){}
+
+        ~SparseSimpleHashTable()
+        {
+            clear();
+        }
+
+        SparseSimpleHashTable(const SparseSimpleHashTable& other)
+        {
+            copyFrom(other);
+        }
+        SparseSimpleHashTable& operator=(const SparseSimpleHashTable& other)
+        {
+            if(this != &other)
+            {
+                clear();
+                copyFrom(other);
+            }
+            return *this;
+        }
+
+        SparseSimpleHashTable(SparseSimpleHashTable&& other) noexcept
+        {
+            groups = std::move(other.groups);
+            totalElements = other.totalElements;
+            other.groups.clear();
+            other.totalElements = 0;
+        }
+        SparseSimpleHashTable& operator=(SparseSimpleHashTable&& other) noexcept
+        {
+            if(this != &other)
+            {
+                clear();
+                groups = std::move(other.groups);
+                totalElements = other.totalElements;
+                other.groups.clear();
+                other.totalElements = 0;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Completely Clears the hash table releasing all memory.
+         *
+         */
+        void clear()
+        {
+            for(size_t i=0; i<groups.size(); i++)
+                releaseGroup(groups[i]);
+            groups = std::vector<Group>();
+            totalElements = 0;
+        }
+
+        template<typename Q = Value, std::enable_if_t<!std::is_same_v<void, Q>, bool> = true>
+        Q& operator[](const Key& k)
+        {
+            return try_insert(k)->second;
+        }
+
+        /**
+         * @brief Attempts to insert into the hash table.
+         *      Returns an iterator to either the newly constructed element or an existing element with the specified key.
+         *
+         * @param v
+         * @return Iterator
+         */
+        Iterator insert(const KeyValueType& v)
+        {
+            return emplace(KeyValueType(v));
+        }
+        Iterator insert(KeyValueType&& v)
+        {
+            return emplace(std::move(v));
+        }
+
+        /**
+         * @brief Emplaces into the hash table.
+         *      May grow the table which rehashes every key. Any insert may invalidate all iterators.
+         *
+         * @param v
+         * @return Iterator
+         */
+        Iterator emplace(KeyValueType&& v)
+        {
+            growIfNeeded();
+            const Key& key = getKey(v);
+            uint64_t slot = 0;
+            if(locate(key, slot))
+                return iteratorAt(slot);
+
+            insertIntoSlot(slot, std::move(v));
+            totalElements++;
+            return iteratorAt(slot);
+        }
+
+        /**
+         * @brief Attempts to either find the provided key or emplace an object with that key constructed from args.
+         *
+         * @param key
+         * @param args
+         * @return Iterator
+         */
+        template<typename K, typename... Args>
+        Iterator try_insert(K&& key, Args&&... args)
+        {
+            growIfNeeded();
+            uint64_t slot = 0;
+            if(locate(key, slot))
+                return iteratorAt(slot);
+
+            insertIntoSlot(slot, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            totalElements++;
+            return iteratorAt(slot);
+        }
+
+        /**
+         * @brief Attempts to find an element by its Key.
+         *      If it exists, returns an iterator to it. Otherwise returns an iterator to the end of the hash table.
+         *
+         * @param k
+         * @return Iterator
+         */
+        Iterator find(const Key& k)
+        {
+            uint64_t slot = 0;
+            if(totalElements != 0 && locate(k, slot))
+                return iteratorAt(slot);
+            return end();
+        }
+
+        /**
+         * @brief Attempts to find an element by its Key and remove it.
+         *      Elements after it in the same cluster may shift back so all iterators are invalidated.
+         *
+         * @param k
+         * @return true if something was removed.
+         */
+        bool erase(const Key& k)
+        {
+            uint64_t slot = 0;
+            if(totalElements == 0 || !locate(k, slot))
+                return false;
+
+            removeFromSlot(slot);
+            totalElements--;
+            backwardShift(slot);
+            return true;
+        }
+
+        /**
+         * @brief Gets the total number of elements added.
+         *
+         * @return size_t
+         */
+        size_t size() const
+        {
+            return totalElements;
+        }
+
+        /**
+         * @brief Get the Total number of slots. Each group of 64 slots costs 16 bytes plus the elements stored in it.
+         *
+         * @return uint64_t
+         */
+        uint64_t getTotalBuckets() const
+        {
+            return groups.size()*GROUP_SIZE;
+        }
+
+        /**
+         * @brief Gets the number of bytes used by the table that are not the elements themselves.
+         *      The bitmaps and pointers for each group.
+         *
+         * @return size_t
+         */
+        size_t getOverheadBytes() const
+        {
+            return groups.capacity()*sizeof(Group);
+        }
+
+        Iterator begin()
+        {
+            return Iterator(this, nextUsedGroup(0), 0);
+        }
+        Iterator end()
+        {
+            return Iterator(this, groups.size(), 0);
+        }
+
+    private:
+        friend Iterator;
+
+        struct Group
+        {
+            uint64_t occupied = 0;
+            KeyValueType* items = nullptr;
+        };
+
+        static const size_t GROUP_SIZE = 64;
+        static const size_t MIN_GROUPS = 1;
+        const float MaxLoadBalance = 0.50;
+
+        size_t groupSize(size_t groupIndex) const
+        {
+            return __builtin_popcountll(groups[groupIndex].occupied);
+        }
+
+        size_t nextUsedGroup(size_t groupIndex) const
+        {
+            while(groupIndex < groups.size() && groups[groupIndex].occupied == 0)
+                groupIndex++;
+            return groupIndex;
+        }
+
+        //spot in the packed array for a slot in the group
+        static size_t getRank(uint64_t occupied, size_t bit)
+        {
+            return __builtin_popcountll(occupied & ((UINT64_C(1) << bit) - 1));
+        }
+
+        bool isOccupied(uint64_t slot) const
+        {
+            return (groups[slot / GROUP_SIZE].occupied >> (slot % GROUP_SIZE)) & 1;
+        }
+
+        KeyValueType& getSlot(uint64_t slot)
+        {
+            const Group& g = groups[slot / GROUP_SIZE];
+            return g.items[getRank(g.occupied, slot % GROUP_SIZE)];
+        }
+
+        Iterator iteratorAt(uint64_t slot)
+        {
+            const Group& g = groups[slot / GROUP_SIZE];
+            return Iterator(this, slot / GROUP_SIZE, getRank(g.occupied, slot % GROUP_SIZE));
+        }
+
+        uint64_t getSlotMask() const
+        {
+            return groups.size()*GROUP_SIZE - 1;
+        }
+
+        uint64_t getDesiredSlot(const Key& key)
+        {
+            return hasher(key) & getSlotMask();
+        }
+
+        //finds the slot holding the key. If it does not exist, slot is set to the first empty slot where it should go.
+        template<typename P>
+        bool locate(const P& key, uint64_t& slot)
+        {
+            uint64_t mask = getSlotMask();
+            slot = hasher(key) & mask;
+            while(isOccupied(slot))
+            {
+                if(LIKELY( keyEqualFunc(getKey(getSlot(slot)), key) ))
+                    return true;
+                slot = (slot+1) & mask;
+            }
+            return false;
+        }
+
+        //constructs a new element in an empty slot. The packed array is reallocated to fit exactly.
+        template<typename... Args>
+        void insertIntoSlot(uint64_t slot, Args&&... args)
+        {
+            Group& g = groups[slot / GROUP_SIZE];
+            size_t bit = slot % GROUP_SIZE;
+            size_t count = __builtin_popcountll(g.occupied);
+            size_t rank = getRank(g.occupied, bit);
+
+            std::allocator<KeyValueType> alloc;
+            KeyValueType* newItems = alloc.allocate(count+1);
+            new (&newItems[rank]) KeyValueType(std::forward<Args>(args)...);
+            for(size_t i=0; i<rank; i++)
+            {
+                new (&newItems[i]) KeyValueType(std::move(g.items[i]));
+                g.items[i].~KeyValueType();
+            }
+            for(size_t i=rank; i<count; i++)
+            {
+                new (&newItems[i+1]) KeyValueType(std::move(g.items[i]));
+                g.items[i].~KeyValueType();
+            }
+            if(g.items != nullptr)
+                alloc.deallocate(g.items, count);
+
+            g.items = newItems;
+            g.occupied |= UINT64_C(1) << bit;
+        }
+
+        void removeFromSlot(uint64_t slot)
+        {
+            Group& g = groups[slot / GROUP_SIZE];
+            size_t bit = slot % GROUP_SIZE;
+            size_t count = __builtin_popcountll(g.occupied);
+            size_t rank = getRank(g.occupied, bit);
+
+            std::allocator<KeyValueType> alloc;
+            KeyValueType* newItems = (count > 1) ? alloc.allocate(count-1) : nullptr;
+            for(size_t i=0; i<count; i++)
+            {
+                if(i != rank)
+                    new (&newItems[(i < rank) ? i : i-1]) KeyValueType(std::move(g.items[i]));
+                g.items[i].~KeyValueType();
+            }
+            alloc.deallocate(g.items, count);
+
+            g.items = newItems;
+            g.occupied &= ~(UINT64_C(1) << bit);
+        }
+
+        //moves an existing element into an empty slot
+        void moveSlot(uint64_t from, uint64_t to)
+        {
+            insertIntoSlot(to, std::move(getSlot(from)));
+            removeFromSlot(from);
+        }
+
+        //same backward shift as SimpleHashTable. Desired slots are recomputed since hashes are not stored.
+        void backwardShift(uint64_t holeSlot)
+        {
+            uint64_t mask = getSlotMask();
+            uint64_t slot = (holeSlot+1) & mask;
+            while(isOccupied(slot))
+            {
+                uint64_t distanceToHole = (slot - holeSlot) & mask;
+                uint64_t distanceFromDesired = (slot - getDesiredSlot(getKey(getSlot(slot)))) & mask;
+                if(distanceFromDesired >= distanceToHole)
+                {
+                    moveSlot(slot, holeSlot);
+                    holeSlot = slot;
+                }
+                slot = (slot+1) & mask;
+            }
+        }
+
+        void growIfNeeded()
+        {
+            if(groups.size() == 0)
+            {
+                groups = std::vector<Group>(MIN_GROUPS);
+                return;
+            }
+            if((float)(totalElements+1) > (float)(groups.size()*GROUP_SIZE) * MaxLoadBalance)
+                rehash(groups.size()*2);
+        }
+
+        void rehash(size_t newGroupCount)
+        {
+            std::vector<Group> oldGroups = std::move(groups);
+            groups = std::vector<Group>(newGroupCount);
+            uint64_t mask = getSlotMask();
+            for(Group& g : oldGroups)
+            {
+                size_t count = __builtin_popcountll(g.occupied);
+                for(size_t i=0; i<count; i++)
+                {
+                    uint64_t slot = getDesiredSlot(getKey(g.items[i]));
+                    while(isOccupied(slot))
+                        slot = (slot+1) & mask;
+                    insertIntoSlot(slot, std::move(g.items[i]));
+                }
+                releaseGroup(g);
+            }
+        }
+
+        void releaseGroup(Group& g)
+        {
+            size_t count = __builtin_popcountll(g.occupied);
+            for(size_t i=0; i<count; i++)
+                g.items[i].~KeyValueType();
+            if(g.items != nullptr)
+                std::allocator<KeyValueType>().deallocate(g.items, count);
+            g.items = nullptr;
+            g.occupied = 0;
+        }
+
+        void copyFrom(const SparseSimpleHashTable& other)
+        {
+            groups = std::vector<Group>(other.groups.size());
+            for(size_t i=0; i<groups.size(); i++)
+            {
+                size_t count = __builtin_popcountll(other.groups[i].occupied);
+                if(count == 0)
+                    continue;
+                groups[i].items = std::allocator<KeyValueType>().allocate(count);
+                for(size_t j=0; j<count; j++)
+                    new (&groups[i].items[j]) KeyValueType(other.groups[i].items[j]);
+                groups[i].occupied = other.groups[i].occupied;
+            }
+            totalElements = other.totalElements;
+        }
+
+        template<class K = KeyValueType>
+        typename std::enable_if<std::is_same_v<Key, K>, const Key&>::type
+        getKey(const KeyValueType& v) const
+        {
+            return v;
+        }
+
+        template<class K = KeyValueType>
+        typename std::enable_if<!std::is_same_v<Key, K>, const Key&>::type
+        getKey(const KeyValueType& v) const
+        {
+            return v.first;
+        }
+
+        std::vector<Group> groups;
+        size_t totalElements = 0;
+
+        HashFunc hasher;
+        KeyEqual keyEqualFunc;
+    };
+}
@@ -0,0 +1,245 @@
+#pragma once
+#include "SimpleHashTable.h"
+#include "SimpleHashSpillFiles.h"
+#include <fstream>
+#include <string>
+
+namespace smpl
+{
+    /**
+     * @brief Default merge for SpillableSimpleHashMap. The newest value replaces the old one.
+     *
+     * @tparam Value
+     */
+    template<typename Value>
+    struct SimpleHashAssignMerge
+    {
+        void operator()(Value& existing, Value&& incoming) const
+        {
+            existing = std::move(incoming);
+        }
+    };
+
+    /**
+     * @brief A map that can grow past the memory available by moving parts of itself to disk.
+     *      Keys are split into partitions by the high bits of their hash. Each partition is its own SimpleHashMap.
+     *      Once the tables use more than the memory budget, the largest partition in memory is written to a file in the spill directory
+     *      and freed. Records for a spilled partition are appended to its file from then on instead of being merged in memory.
+     *
+     *      Spilled partitions are loaded again one at a time by forEachPartition() which merges every record for the same key
+     *      with MergeFunc. Only one spilled partition is ever loaded at once so a job can finish with bounded memory.
+     *      A single partition must still fit in memory. Use more partitions if that is not the case.
+     *
+     *      Memory usage is measured with SimpleHashTable::getMemoryUsage() so memory owned by the elements is not counted.
+     *
+     * @tparam Key
+     * @tparam Value
+     * @tparam MergeFunc
+     *      Called as merge(Value& existing, Value&& incoming) when a key is inserted again.
+     * @tparam HashFunc
+     * @tparam KeyEqual
+     * @tparam BIG
+     */
+    template<typename Key, typename Value, typename MergeFunc = SimpleHashAssignMerge<Value>, typename HashFunc = TestHashFunction<Key>, typename KeyEqual = std::equal_to<Key>, bool BIG = false>
+    class SpillableSimpleHashMap
+    {
+    public:
+        using TableType = SimpleHashMap<Key, Value, HashFunc, KeyEqual, BIG>;
+        using KeyValueType = std::pair<Key, Value>;
+
+        /**
+         * @brief Construct a new Spillable Simple Hash Map.
+         *      Throws std::runtime_error if the spill directory can not be created.
+         *
+         * @param spillDirectory
+         *      Where partition files are written. Created if it does not exist. Files are removed when the map is destroyed.
+         * @param memoryBudget
+         *      Bytes the in memory partitions may use before partitions are spilled.
+         * @param partitionCount
+         *      Rounded up to a power of 2.
+         * @param merge
+         */
+        SpillableSimpleHashMap(const std::string& spillDirectory, uint64_t memoryBudget, size_t partitionCount = 64, MergeFunc merge = MergeFunc())
+        {
+            this->memoryBudget = memoryBudget;
+            this->merge = merge;
+
+            partitionBits = 0;
+            while(((size_t)1 << partitionBits) < partitionCount)
+                partitionBits++;
+            partitions = std::vector<Partition>((size_t)1 << partitionBits);
+            spillFiles.open(spillDirectory, "spill");
+        }
+
+        SpillableSimpleHashMap(const SpillableSimpleHashMap& other) = delete;
+        SpillableSimpleHashMap& operator=(const SpillableSimpleHashMap& other) = delete;
+
+        /**
+         * @brief Inserts the key or merges the value into the existing one.
+         *      If the key's partition is spilled, the record is appended to its file and merged when the partition is loaded.
+         *
+         * @param key
+         * @param value
+         */
+        void insert_or_merge(const Key& key, Value value)
+        {
+            uint64_t hash = partitions[0].table.hashKey(key);
+            size_t index = getPartitionIndex(hash);
+            Partition& p = partitions[index];
+            if(spillFiles.exists(index))
+            {
+                std::fstream& file = spillFiles.getFile(index);
+                SimpleHashSpillFiles::writeItem(file, key);
+                SimpleHashSpillFiles::writeItem(file, value);
+                p.spilledRecords++;
+                return;
+            }
+
+            uint64_t usageBefore = p.table.getMemoryUsage();
+            mergeInto(p.table, hash, KeyValueType(key, std::move(value)));
+            memoryUsed += p.table.getMemoryUsage() - usageBefore;
+
+            while(memoryUsed > memoryBudget && spillLargestPartition())
+            {
+            }
+        }
+
+        /**
+         * @brief Calls func(TableType& partition) for every partition with every record for its keys merged.
+         *      Partitions in memory are passed directly. Spilled partitions are loaded one at a time into a temporary table
+         *      which is freed after func returns. Spilled partitions stay on disk.
+         *
+         * @tparam F
+         * @param func
+         */
+        template<typename F>
+        void forEachPartition(F&& func)
+        {
+            for(size_t i=0; i<partitions.size(); i++)
+            {
+                if(!spillFiles.exists(i))
+                {
+                    func(partitions[i].table);
+                    continue;
+                }
+
+                TableType loaded = loadSpilledPartition(i);
+                func(loaded);
+            }
+        }
+
+        /**
+         * @brief Gets the bytes used by the partitions that are in memory. See SimpleHashTable::getMemoryUsage()
+         *
+         * @return uint64_t
+         */
+        uint64_t getMemoryUsage()
+        {
+            return memoryUsed;
+        }
+
+        /**
+         * @brief Gets the number of partitions that were written to disk.
+         *
+         * @return size_t
+         */
+        size_t getSpilledPartitionCount()
+        {
+            size_t count = 0;
+            for(size_t i=0; i<partitions.size(); i++)
+                count += spillFiles.exists(i);
+            return count;
+        }
+
+        size_t getPartitionCount()
+        {
+            return partitions.size();
+        }
+
+    private:
+        struct Partition
+        {
+            TableType table; //empty once the partition is spilled
+            uint64_t spilledRecords = 0;
+        };
+
+        size_t getPartitionIndex(uint64_t hash)
+        {
+            //the tables use the low bits to pick buckets so the high bits are used here
+            return (partitionBits == 0) ? 0 : (size_t)(hash >> (64 - partitionBits));
+        }
+
+        void mergeInto(TableType& table, uint64_t hash, KeyValueType&& kv)
+        {
+            //insertHashed() does not touch kv if the key already exists
+            uint64_t sizeBefore = table.size();
+            auto it = table.insertHashed(hash, std::move(kv));
+            if(table.size() == sizeBefore)
+                merge(it->second, std::move(kv.second));
+        }
+
+        //returns false if nothing in memory could be spilled
+        bool spillLargestPartition()
+        {
+            size_t largest = partitions.size();
+            uint64_t largestUsage = 0;
+            for(size_t i=0; i<partitions.size(); i++)
+            {
+                uint64_t usage = partitions[i].table.getMemoryUsage();
+                if(!spillFiles.exists(i) && usage > largestUsage)
+                {
+                    largest = i;
+                    largestUsage = usage;
+                }
+            }
+            if(largest == partitions.size())
+                return false;
+
+            Partition& p = partitions[largest];
+            std::fstream& file = spillFiles.getFile(largest);
+            for(const KeyValueType& kv : p.table)
+            {
+                SimpleHashSpillFiles::writeItem(file, kv.first);
+                SimpleHashSpillFiles::writeItem(file, kv.second);
+            }
+            p.spilledRecords = p.table.size();
+
+            memoryUsed -= largestUsage;
+            p.table = TableType(); //the destructor releases the memory. clear() would only hand the buckets to the recycler
+            return true;
+        }
+
+        TableType loadSpilledPartition(size_t index)
+        {
+            Partition& p = partitions[index];
+            std::fstream& file = spillFiles.getFile(index);
+            file.flush();
+            if(!file)
+                throw std::runtime_error("SPILL WRITE FAILED");
+
+            TableType loaded;
+            loaded.reserve(p.spilledRecords); //upper bound since keys may repeat
+            file.seekg(0);
+            {
+                SimpleHashSnapshotReader reader(file);
+                for(uint64_t i=0; i<p.spilledRecords; i++)
+                {
+                    Key key = SimpleHashSerializer<Key>::read(reader);
+                    Value value = SimpleHashSerializer<Value>::read(reader);
+                    uint64_t hash = loaded.hashKey(key);
+                    mergeInto(loaded, hash, KeyValueType(std::move(key), std::move(value)));
+                }
+            }
+            file.clear();
+            file.seekp(0, std::ios::end); //continue appending after the records
+            return loaded;
+        }
+
+        std::vector<Partition> partitions;
+        size_t partitionBits = 0;
+        uint64_t memoryBudget = 0;
+        uint64_t memoryUsed = 0;
+        MergeFunc merge;
+        SimpleHashSpillFiles spillFiles;
+    };
+}
@@ -8,7 +8,15 @@
 
 #include "ImportantInclude.h"
 #include "SimpleHashTable.h"
-
+#include "SimpleHashLoader.h"
+#include "SimpleHashJoin.h"
+#include "SimpleHashHyperLogLog.h"
+#include "CountingSimpleHashTable.h"
+#include "ConcurrentSimpleHashTable.h"
+#include "LruSimpleHashTable.h"
+
+#include <fstream>
+#include <list>
 #include <map>
 #include <flat_map>
 #include <unordered_map>
@@ -55,6 +63,17 @@ void createEmptyDataStructure()
 }
 
 
+//request handler pattern. A map is made, filled with a few thousand entries, and destroyed.
+template<typename T>
+void createFillAndDestroy()
+{
+    T map;
+    for(int i=0; i<4000; i++)
+    {
+        map.insert({(size_t)i*31, MemInfo(1)});
+    }
+}
+
 template<typename T>
 void fillWithIterableData()
 {
@@ -222,6 +241,438 @@ void benchmarkAllOps()
     printf("\tAverage Remove Time = %llu\n", avgRemoveTime);
 }
 
+#define SMALL_MAP_COUNT 100000
+#define SMALL_MAP_ELEMENTS 12
+
+//lots of tiny maps like the ones stored in per-object metadata
+template<typename T>
+void fillSmallMaps(std::vector<T>& maps)
+{
+    for(T& map : maps)
+    {
+        map.clear();
+        for(int i=0; i<SMALL_MAP_ELEMENTS; i++)
+        {
+            map.insert({(size_t)i*7, MemInfo(1)});
+        }
+    }
+}
+
+template<typename T>
+void searchSmallMaps(std::vector<T>& maps, std::vector<MemInfo>& collectedData)
+{
+    for(T& map : maps)
+    {
+        auto it = map.find((rand() % (SMALL_MAP_ELEMENTS*2))*7);
+        if(it != map.end())
+        {
+            collectedData.push_back(it->second);
+        }
+    }
+}
+
+template<typename T>
+void eraseSmallMaps(std::vector<T>& maps)
+{
+    for(T& map : maps)
+    {
+        for(int i=0; i<SMALL_MAP_ELEMENTS; i+=2)
+        {
+            map.erase((size_t)i*7);
+        }
+    }
+}
+
+template<typename T>
+void benchmarkSmallOps()
+{
+    std::vector<MemInfo> collectedData;
+    int status;
+    char* p = abi::__cxa_demangle(typeid(T).name(), NULL, NULL, &status);
+    std::string demangledName = p;
+    delete[] p;
+
+    std::vector<T> maps = std::vector<T>(SMALL_MAP_COUNT);
+    printf("Time to benchmark %d small %s\n", SMALL_MAP_COUNT, demangledName.c_str());
+
+    size_t avgFillTime = benchmarkFunction(fillSmallMaps<T>, maps);
+    printf("\tAverage Fill Time = %llu\n", avgFillTime);
+    
+    size_t avgSearchTime = benchmarkFunction(searchSmallMaps<T>, maps, collectedData);
+    printf("\tAverage Search Time = %llu\n", avgSearchTime);
+
+    size_t avgEraseTime = benchmarkFunction(eraseSmallMaps<T>, maps);
+    printf("\tAverage Erase Time = %llu\n", avgEraseTime);
+}
+
+#define LOADER_FILE "loaderTest.tsv"
+
+//startup pattern. A large tab separated dump is loaded into a map.
+void writeLoaderFile()
+{
+    std::ofstream file(LOADER_FILE, std::ios::binary);
+    for(size_t i=0; i<10*MILLION; i++)
+    {
+        file << (size_t)rand()*rand() << '\t' << rand() << '\n';
+    }
+}
+
+void loadSequentially()
+{
+    smpl::SimpleHashMap<size_t, int> map;
+    std::ifstream file(LOADER_FILE, std::ios::binary);
+    size_t key;
+    int value;
+    while(file >> key >> value)
+    {
+        map.insert({key, value});
+    }
+}
+
+void loadInParallel()
+{
+    smpl::SimpleHashMap<size_t, int> map;
+    smpl::SimpleHashLoader::loadDelimited(map, LOADER_FILE);
+}
+
+void benchmarkLoader()
+{
+    writeLoaderFile();
+    printf("Time to load %d lines\n", 10*MILLION);
+    printf("\tAverage Sequential Load Time = %llu\n", benchmarkFunction(loadSequentially));
+    printf("\tAverage Parallel Load Time = %llu\n", benchmarkFunction(loadInParallel));
+    std::remove(LOADER_FILE);
+}
+
+//query pattern. A large relation is joined with a smaller one on a key.
+struct JoinRow
+{
+    size_t key;
+    size_t payload;
+};
+std::vector<JoinRow> joinBuildSide;
+std::vector<JoinRow> joinProbeSide;
+size_t joinMatches = 0; //keeps the joins from being optimized away
+
+void makeJoinRelations()
+{
+    joinBuildSide.clear();
+    joinProbeSide.clear();
+    for(size_t i=0; i<MILLION; i++)
+    {
+        joinBuildSide.push_back({i*7919, i});
+    }
+    for(size_t i=0; i<10*MILLION; i++)
+    {
+        joinProbeSide.push_back({((size_t)rand()*rand() % (2*MILLION))*7919, i}); //about half match
+    }
+}
+
+void joinWithFindLoop()
+{
+    smpl::SimpleHashMap<size_t, size_t> map;
+    for(const JoinRow& row : joinBuildSide)
+    {
+        map.insert({row.key, row.payload});
+    }
+    size_t matches = 0;
+    for(const JoinRow& row : joinProbeSide)
+    {
+        matches += (map.find(row.key) != map.end());
+    }
+    joinMatches = matches;
+}
+
+void joinPartitioned()
+{
+    std::vector<size_t> matches(std::thread::hardware_concurrency()+1);
+    smpl::SimpleHashJoin<size_t>::join(joinBuildSide, [](const JoinRow& r){ return r.key; }, joinProbeSide, [](const JoinRow& r){ return r.key; },
+        smpl::SimpleHashJoinType::INNER, [&](size_t thread, const JoinRow& probeRow, const JoinRow* buildRow){ matches[thread]++; });
+    joinMatches = 0;
+    for(size_t m : matches)
+    {
+        joinMatches += m;
+    }
+}
+
+void benchmarkJoin()
+{
+    makeJoinRelations();
+    printf("Time to join %d rows with %d rows\n", 10*MILLION, MILLION);
+    printf("\tAverage Find Loop Time = %llu\n", benchmarkFunction(joinWithFindLoop));
+    printf("\tAverage Partitioned Join Time = %llu\n", benchmarkFunction(joinPartitioned));
+}
+
+//bulk build with many duplicate keys. Reserving for every row would oversize the table so only the distinct count helps.
+std::vector<std::pair<size_t, size_t>> bulkRows;
+
+void makeBulkRows()
+{
+    bulkRows.clear();
+    for(size_t i=0; i<10*MILLION; i++)
+    {
+        bulkRows.push_back({((size_t)rand()*rand() % (2*MILLION))*7919, i});
+    }
+}
+
+void bulkBuildWithInsert()
+{
+    smpl::SimpleHashMap<size_t, size_t> map;
+    for(const std::pair<size_t, size_t>& row : bulkRows)
+    {
+        map.insert(row);
+    }
+    joinMatches = map.size();
+}
+
+void bulkBuildWithSketch()
+{
+    smpl::SimpleHashMap<size_t, size_t> map;
+    smpl::SimpleHashHyperLogLog<size_t>::bulkInsert(map, bulkRows.begin(), bulkRows.end());
+    joinMatches = map.size();
+}
+
+void benchmarkBulkBuild()
+{
+    makeBulkRows();
+    printf("Time to build a table from %d rows\n", 10*MILLION);
+    printf("\tAverage Insert Loop Time = %llu\n", benchmarkFunction(bulkBuildWithInsert));
+    printf("\tAverage Sketch Sized Time = %llu\n", benchmarkFunction(bulkBuildWithSketch));
+}
+
+//skewed stream of keys where the 10 most frequent are wanted at the end
+std::vector<size_t> countedKeys;
+size_t topKeyCount = 0; //keeps the counting from being optimized away
+
+void makeCountedKeys()
+{
+    countedKeys.clear();
+    for(size_t i=0; i<10*MILLION; i++)
+    {
+        double u = (double)rand() / RAND_MAX;
+        countedKeys.push_back((size_t)(u*u*u * 2*MILLION)); //small keys are much more common
+    }
+}
+
+void countWithMapAndSort()
+{
+    smpl::SimpleHashMap<size_t, size_t> map;
+    for(size_t key : countedKeys)
+    {
+        map[key]++;
+    }
+    std::vector<std::pair<size_t, size_t>> all(map.begin(), map.end());
+    std::sort(all.begin(), all.end(), [](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b){ return a.second > b.second; });
+    topKeyCount = all[0].second;
+}
+
+void countWithCountingMap()
+{
+    smpl::CountingSimpleHashMap<size_t> map(10);
+    for(size_t key : countedKeys)
+    {
+        map.increment(key);
+    }
+    topKeyCount = map.getTopK(10)[0].second;
+}
+
+void benchmarkCounting()
+{
+    makeCountedKeys();
+    printf("Time to count %d keys and find the 10 most frequent\n", 10*MILLION);
+    printf("\tAverage map[key]++ and Sort Time = %llu\n", benchmarkFunction(countWithMapAndSort));
+    printf("\tAverage Counting Map Time = %llu\n", benchmarkFunction(countWithCountingMap));
+}
+
+//smart pointer registry pattern. The keys are fixed while every thread changes reference counts.
+struct AtomicMemInfo
+{
+    AtomicMemInfo(int v)
+    {
+        counter = v;
+    }
+    std::atomic<int> lockCount = 0;
+    std::atomic<int> counter = 0;
+};
+const int REGISTRY_THREADS = 4;
+const int REGISTRY_KEYS = 100000;
+
+void registryWithMutex()
+{
+    smpl::SimpleHashMap<size_t, MemInfo> map;
+    std::mutex mapMutex;
+    for(int i=0; i<REGISTRY_KEYS; i++)
+    {
+        map.insert({(size_t)i*31, MemInfo(1)});
+    }
+    std::vector<std::thread> threads;
+    for(int t=0; t<REGISTRY_THREADS; t++)
+    {
+        threads.emplace_back([&, t](){
+            for(int i=0; i<MILLION; i++)
+            {
+                std::lock_guard<std::mutex> lock(mapMutex);
+                map.find((size_t)((i*7 + t) % REGISTRY_KEYS)*31)->second.lockCount++;
+            }
+        });
+    }
+    for(std::thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+void registryConcurrent()
+{
+    smpl::ConcurrentSimpleHashMap<size_t, AtomicMemInfo> map(REGISTRY_KEYS);
+    for(int i=0; i<REGISTRY_KEYS; i++)
+    {
+        map.try_emplace((size_t)i*31, 1);
+    }
+    std::vector<std::thread> threads;
+    for(int t=0; t<REGISTRY_THREADS; t++)
+    {
+        threads.emplace_back([&, t](){
+            for(int i=0; i<MILLION; i++)
+            {
+                map.find((size_t)((i*7 + t) % REGISTRY_KEYS)*31)->lockCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for(std::thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+void benchmarkRegistry()
+{
+    printf("Time for %d threads to update %d reference counts each\n", REGISTRY_THREADS, MILLION);
+    printf("\tAverage Mutex Time = %llu\n", benchmarkFunction(registryWithMutex));
+    printf("\tAverage Lock Free Find Time = %llu\n", benchmarkFunction(registryConcurrent));
+}
+
+//bounded cache. Every request looks the key up and inserts it on a miss (evicting the least recently used key if full).
+const size_t LRU_CAPACITY = 100000;
+std::vector<size_t> lruRequests;
+double lruHitRate = 0;
+
+void makeLruRequests()
+{
+    lruRequests.clear();
+    for(size_t i=0; i<10*MILLION; i++)
+    {
+        double u = (double)rand() / RAND_MAX;
+        lruRequests.push_back((size_t)(u*u*u * MILLION)*31); //small keys are much more common
+    }
+}
+
+void lruWithList()
+{
+    //the usual composite. The map points at the key's node in the recency list.
+    std::list<std::pair<size_t, MemInfo>> order;
+    smpl::SimpleHashMap<size_t, std::list<std::pair<size_t, MemInfo>>::iterator> map;
+    size_t hits = 0;
+    for(size_t key : lruRequests)
+    {
+        auto it = map.find(key);
+        if(it != map.end())
+        {
+            order.splice(order.begin(), order, it->second);
+            it->second->second.lockCount++;
+            hits++;
+            continue;
+        }
+        if(map.size() >= LRU_CAPACITY)
+        {
+            map.erase(order.back().first);
+            order.pop_back();
+        }
+        order.emplace_front(key, MemInfo(1));
+        map.insert({key, order.begin()});
+    }
+    lruHitRate = (double)hits / lruRequests.size();
+}
+
+void lruIntrusive()
+{
+    smpl::LruSimpleHashMap<size_t, MemInfo> cache(LRU_CAPACITY);
+    for(size_t key : lruRequests)
+    {
+        MemInfo* info = cache.find(key);
+        if(info != nullptr)
+        {
+            info->lockCount++;
+            continue;
+        }
+        cache.insert_or_assign(key, MemInfo(1));
+    }
+    lruHitRate = cache.getHitRate();
+}
+
+void benchmarkLru()
+{
+    makeLruRequests();
+    printf("Time for %d requests to a cache of %llu keys\n", 10*MILLION, (unsigned long long)LRU_CAPACITY);
+    printf("\tAverage List Composite Time = %llu\n", benchmarkFunction(lruWithList));
+    printf("\tList Composite Hit Rate = %.4f\n", lruHitRate);
+    printf("\tAverage LruSimpleHashMap Time = %llu\n", benchmarkFunction(lruIntrusive));
+    printf("\tLruSimpleHashMap Hit Rate = %.4f\n", lruHitRate);
+}
+
+//tables whose elements own heap memory. Clearing destroys every element unless the storage is handed to the reclaimer.
+using TeardownMap = smpl::SimpleHashMap<size_t, std::string>;
+size_t teardownClearTime = 0; //only the clear itself. Filling is not counted
+
+void fillTeardownMap(TeardownMap& map)
+{
+    for(size_t i=0; i<MILLION; i++)
+    {
+        map.insert({i*31, std::string(40, 'x')});
+    }
+}
+
+void teardownInPlace()
+{
+    TeardownMap map;
+    fillTeardownMap(map);
+    size_t startTime = getTimeNano();
+    map.clear();
+    teardownClearTime += getTimeNano() - startTime;
+}
+
+void teardownAsync()
+{
+    TeardownMap map;
+    fillTeardownMap(map);
+    size_t startTime = getTimeNano();
+    map.clear_async();
+    teardownClearTime += getTimeNano() - startTime;
+}
+
+//a static table created before the reclaimer is first used is destroyed after the reclaimer at exit.
+//Its destructor must free the storage itself instead of retiring it.
+TeardownMap& getStaticTeardownMap()
+{
+    static TeardownMap map;
+    return map;
+}
+
+void benchmarkTeardown()
+{
+    TeardownMap& staticMap = getStaticTeardownMap();
+    fillTeardownMap(staticMap);
+    staticMap.setDeferredDestruction(true);
+
+    printf("Time to clear %d strings on the calling thread\n", MILLION);
+    teardownClearTime = 0;
+    benchmarkFunction(teardownInPlace);
+    printf("\tAverage Clear Time = %llu\n", (unsigned long long)(teardownClearTime / ITERATIONS));
+    teardownClearTime = 0;
+    benchmarkFunction(teardownAsync);
+    printf("\tAverage Async Clear Time = %llu\n", (unsigned long long)(teardownClearTime / ITERATIONS));
+}
+
 template<typename T>
 bool checkingIfValid()
 {
@@ -236,6 +687,37 @@ int main()
 //     printf("TEST MAPS:______________________\n");
 //     benchmarkAllOps<smpl::SimpleHashMap<size_t, MemInfo, std::hash<size_t>>>();
 
+//     printf("SMALL MAPS:______________________\n");
+//     benchmarkSmallOps<std::flat_map<size_t, MemInfo>>();
+//     benchmarkSmallOps<std::unordered_map<size_t, MemInfo>>();
+//     benchmarkSmallOps<smpl::SimpleHashMap<size_t, MemInfo>>();
+
+//     printf("CHURN:______________________\n");
+//     printf("\tAverage Create/Fill/Destroy Time = %llu\n", benchmarkFunction(createFillAndDestroy<smpl::SimpleHashMap<size_t, MemInfo>>));
+//     smpl::SimpleHashMap<size_t, MemInfo>::getRecycler().setMaxRetainedBytes(1<<24);
+//     printf("\tAverage Recycled Create/Fill/Destroy Time = %llu\n", benchmarkFunction(createFillAndDestroy<smpl::SimpleHashMap<size_t, MemInfo>>));
+
+//     printf("LOADER:______________________\n");
+//     benchmarkLoader();
+
+//     printf("JOIN:______________________\n");
+//     benchmarkJoin();
+
+//     printf("BULK BUILD:______________________\n");
+//     benchmarkBulkBuild();
+
+//     printf("COUNTING:______________________\n");
+//     benchmarkCounting();
+
+//     printf("REGISTRY:______________________\n");
+//     benchmarkRegistry();
+
+//     printf("LRU:______________________\n");
+//     benchmarkLru();
+
+//     printf("TEARDOWN:______________________\n");
+//     benchmarkTeardown(); //also checks the static table destroyed after the reclaimer at exit
+
 
     std::unordered_map<size_t, MemInfo> map = std::unordered_map<size_t, MemInfo>();
     fillWithIterableDataRef<std::unordered_map<size_t, MemInfo>>(map);